@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Loop/MemoryManager.h"
+#include "Loop/VirtualMachine.h"
+
+#include "Loop/Objects/String.h"
+
+// Loop programs cannot build strings at run time, so this driver interns "string-<n>" through the VM
+// directly. Every tenth of the way it reports the average time of the new strings since the last
+// report, and of looking up existing strings again. Both stay flat when interning does not depend on
+// the number of live strings. The collector is off outside of scripts, so every string stays live.
+
+#define LOOKUPS_COUNT 100000
+
+static void Intern(VirtualMachine* vm, size_t n)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "string-%zu", n);
+    ObjectStringFromLiteral(vm, buffer);
+}
+
+int main(int argc, const char* argv[])
+{
+    const size_t total = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    const size_t step = total / 10;
+    if (step == 0)
+    {
+        fprintf(stderr, "usage: stringInterning [<strings count, at least 10>]\n");
+        return 1;
+    }
+
+    VirtualMachine* vm = malloc(sizeof(VirtualMachine));
+    if (vm == NULL)
+    {
+        return Error_OutOfMemory;
+    }
+
+    // The VM needs LOOP_PACKAGES_PATH like loopvm does.
+    {
+        Error err = VirtualMachineInit(vm);
+        if (err != Error_None)
+        {
+            VirtualMachineDeinit(vm);
+            free(vm);
+            return err;
+        }
+    }
+
+    printf("%10s %12s %12s\n", "live", "insert ns", "lookup ns");
+
+    uint64_t start = MemoryManagerNowNanoseconds();
+    for (size_t i = 0; i < total; ++i)
+    {
+        Intern(vm, i);
+
+        if ((i + 1) % step != 0)
+        {
+            continue;
+        }
+
+        const uint64_t inserted = MemoryManagerNowNanoseconds();
+        for (size_t j = 0; j < LOOKUPS_COUNT; ++j)
+        {
+            Intern(vm, (j * 7919) % (i + 1));
+        }
+        const uint64_t looked_up = MemoryManagerNowNanoseconds();
+
+        printf("%10zu %12.0f %12.0f\n", i + 1, (double) (inserted - start) / (double) step,
+               (double) (looked_up - inserted) / LOOKUPS_COUNT);
+        start = MemoryManagerNowNanoseconds();
+    }
+
+    VirtualMachineDeinit(vm);
+    free(vm);
+    return 0;
+}
@@ -9,6 +9,8 @@ from loop_compiler.passes.read_file import read_loop_file
 from loop_compiler.passes.loop_parser import parse_loop_module
 from loop_compiler.passes.semantic_check import perform_semantic_check
 from loop_compiler.passes.compiler import compile_module
+from loop_compiler.passes.optimize import optimize_module
+from loop_compiler.passes.stack_depth import set_stack_sizes
 from loop_compiler.passes.write_chunk import write_chunk
 
 from loop_compiler.util.error_listener import ErrorListener
@@ -33,7 +35,9 @@ def full_passes(
     if file := read_loop_file(resolved):
         if module := str_to_loop_module_checked(error_listener, file, **kwargs):
             if chunk := compile_module(error_listener, module):
-                return write_chunk(compiled, chunk)
+                if kwargs.get("optimize"):
+                    chunk = optimize_module(chunk)
+                return write_chunk(compiled, set_stack_sizes(chunk))
     else:
         error_listener.error(parent_pos, f"file not found: '{path}'")
 
@@ -1,7 +1,9 @@
 from abc import ABC, abstractmethod
 from dataclasses import dataclass
 from enum import Enum, auto
-from typing import Any, Dict, List
+from typing import Any, Dict, List, Tuple
+
+from loop_compiler.util.binary_writer import BinaryWriter
 
 
 class Opcode(Enum):
@@ -55,6 +57,17 @@ class Opcode(Enum):
     Throw = 47
     # NEW
     InstanceOf = 48
+    Invoke = 49
+    Wide = 50
+    LessEqual = 51
+    GreaterEqual = 52
+    NotEqual = 53
+    SetLocalPop = 54
+    SetGlobalPop = 55
+    AddLocalLocal = 56
+    IncrementLocal = 57
+    LessJumpIfFalse = 58
+    LessLocalConstJumpIfFalse = 59
 
 
 class LongInst(Enum):
@@ -66,6 +79,23 @@ class LongInst(Enum):
     GetExport = auto()
     SetExport = auto()
     SuperGet = auto()
+    Invoke = auto()
+
+
+BINARY_MAGIC = b"LOOP"
+BINARY_VERSION = 5
+
+# Ints are 62 bits wide in the tagged values of loopvm and 64 bits without them. Literals and
+# folded constants keep to the narrower range.
+INT_MIN = -(2**61)
+INT_MAX = 2**61 - 1
+
+
+class BinaryType(Enum):
+    Integer = 0
+    String = 1
+    Function = 2
+    Class = 3
 
 
 class Value(ABC):
@@ -75,6 +105,10 @@ class Value(ABC):
             "data": self.make_json_object_data(),
         }
 
+    def write_binary_object(self, writer: BinaryWriter):
+        writer.u8(BinaryType[self.get_type()].value)
+        self.write_binary_object_data(writer)
+
     @abstractmethod
     def get_type(self) -> str:
         raise NotImplementedError()
@@ -83,12 +117,20 @@ class Value(ABC):
     def make_json_object_data(self) -> Any:
         raise NotImplemented()
 
+    @abstractmethod
+    def write_binary_object_data(self, writer: BinaryWriter):
+        raise NotImplemented()
+
 
 @dataclass
 class Chunk:
     code: List[int]
     constants: List[Value]
-    lines: List[int]
+    # (offset, line) for the first byte of every run of bytes on the same line.
+    lines: List[Tuple[int, int]]
+    locals_count: int
+    # Slots of the frame, filled in by set_stack_sizes once the code is final.
+    stack_size: int = 0
 
     def get_type(self) -> str:
         return "Chunk"
@@ -97,9 +139,25 @@ class Chunk:
         return {
             "code": self.code,
             "constants": list(map(lambda v: v.make_json_object(), self.constants)),
-            "lines": self.lines,
+            "lines": [list(run) for run in self.lines],
+            "locals_count": self.locals_count,
+            "stack_size": self.stack_size,
         }
 
+    def write_binary_object_data(self, writer: BinaryWriter):
+        writer.u32(len(self.code))
+        writer.u32(len(self.lines))
+        writer.u32(len(self.constants))
+        writer.u32(self.locals_count)
+        writer.u32(self.stack_size)
+        writer.raw(bytes(self.code))
+        writer.align(4)
+        for offset, line in self.lines:
+            writer.u32(offset)
+            writer.u32(line)
+        for constant in self.constants:
+            constant.write_binary_object(writer)
+
 
 @dataclass
 class IntegerValue(Value):
@@ -111,6 +169,9 @@ class IntegerValue(Value):
     def make_json_object_data(self) -> Any:
         return self.num
 
+    def write_binary_object_data(self, writer: BinaryWriter):
+        writer.i64(self.num)
+
 
 @dataclass
 class StringValue(Value):
@@ -122,6 +183,9 @@ class StringValue(Value):
     def make_json_object_data(self) -> Any:
         return self.txt
 
+    def write_binary_object_data(self, writer: BinaryWriter):
+        writer.string(self.txt)
+
 
 @dataclass
 class FunctionValue(Value):
@@ -139,6 +203,11 @@ class FunctionValue(Value):
             "chunk": self.body.make_json_object_data(),
         }
 
+    def write_binary_object_data(self, writer: BinaryWriter):
+        writer.string(self.name)
+        writer.u32(self.arity)
+        self.body.write_binary_object_data(writer)
+
 
 @dataclass
 class ModuleValue(Value):
@@ -154,6 +223,12 @@ class ModuleValue(Value):
             "chunk": self.script.make_json_object_data(),
         }
 
+    def write_binary_object_data(self, writer: BinaryWriter):
+        writer.raw(BINARY_MAGIC)
+        writer.u32(BINARY_VERSION)
+        writer.u32(self.globals_count)
+        self.script.write_binary_object_data(writer)
+
 
 @dataclass
 class ClassValue(Value):
@@ -168,3 +243,9 @@ class ClassValue(Value):
             "name": self.name,
             "methods": list(map(lambda v: v.make_json_object(), self.methods)),
         }
+
+    def write_binary_object_data(self, writer: BinaryWriter):
+        writer.string(self.name)
+        writer.u32(len(self.methods))
+        for method in self.methods:
+            method.write_binary_object_data(writer)
@@ -0,0 +1,193 @@
+import argparse
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+from typing import Optional
+
+from loop_compiler.full_passes import full_passes
+from loop_compiler.passes.read_file import read_loop_file
+from loop_compiler.util.default_error_listener import DefaultErrorListener
+
+BENCHMARK_FOLDER = "benchmarks"
+DEFAULT_BASELINE = os.path.join(BENCHMARK_FOLDER, "baseline.json")
+
+# Relative change of the fastest run that is reported as a regression. The fastest run
+# is the least disturbed by the rest of the machine.
+REGRESSION_THRESHOLD = 0.10
+
+
+def list_benchmarks(names: list[str]) -> list[str]:
+    # Modules starting with "_" are only imported by the benchmarks.
+    found = sorted(
+        os.path.splitext(path)[0]
+        for path in os.listdir(BENCHMARK_FOLDER)
+        if path.endswith(".loop") and not path.startswith("_")
+    )
+
+    for name in names:
+        if name not in found:
+            print(f"error: unknown benchmark '{name}'")
+            sys.exit(2)
+
+    return [name for name in found if not names or name in names]
+
+
+def expected_output(path: str) -> str:
+    file = read_loop_file(path).contents
+    return "".join(match[3:] + "\n" for match in re.findall(r"// [^\n]*", file))
+
+
+def run_once(path: str, *options: str) -> tuple[float, str]:
+    """Returns the wall time and the output of one loopvm run."""
+    start = time.perf_counter()
+    p = subprocess.run(
+        ["loopvm", *options, path], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL
+    )
+    elapsed = time.perf_counter() - start
+
+    if p.returncode != 0:
+        raise RuntimeError(f"loopvm exited with {p.returncode}")
+
+    return elapsed, p.stdout.decode().replace("\r\n", "\n").replace("\r", "\n")
+
+
+def read_report(path: str) -> dict:
+    with open(path) as file:
+        return json.load(file)
+
+
+def run_benchmark(name: str, runs: int) -> Optional[dict]:
+    path = os.path.join(BENCHMARK_FOLDER, name)
+    expected = expected_output(path + ".loop")
+
+    times = []
+    rss = []
+    gc_seconds = []
+    pauses = []
+
+    with tempfile.TemporaryDirectory() as directory:
+        gc_path = os.path.join(directory, "gc.json")
+        profile_path = os.path.join(directory, "profile.json")
+
+        # A crashing benchmark is reported as failed, the others still run.
+        try:
+            for _ in range(runs):
+                elapsed, output = run_once(path, f"--gc-stats={gc_path}")
+                if output != expected:
+                    print(f"error: {name}: output mismatch")
+                    return None
+
+                # The peak RSS comes from loopvm itself, the one of a child process
+                # includes the peak of this interpreter on Linux.
+                stats = read_report(gc_path)
+                times.append(elapsed)
+                gc_seconds.append(stats["gc_seconds"])
+                pauses.append(stats["max_pause_seconds"])
+                rss.append(stats["peak_rss_bytes"])
+
+            # Counting opcodes slows the run down, so it gets a run of its own.
+            run_once(path, f"--profile-opcodes={profile_path}")
+            instructions = read_report(profile_path)["total"]
+        except RuntimeError as error:
+            print(f"error: {name}: {error}")
+            return None
+
+    return {
+        "runs": runs,
+        "wall_seconds": statistics.median(times),
+        "wall_seconds_min": min(times),
+        "instructions": instructions,
+        "gc_seconds": statistics.median(gc_seconds),
+        "max_pause_seconds": max(pauses),
+        "peak_rss_bytes": max(rss),
+    }
+
+
+def format_ratio(value: float, baseline: Optional[float]) -> str:
+    if not baseline:
+        return ""
+
+    return f"({value / baseline:.2f}x)"
+
+
+def print_results(results: dict, baseline: dict) -> int:
+    """Prints a row per benchmark and returns the number of regressions."""
+    regressions = 0
+
+    print(
+        f"{'benchmark':<16} {'median s':>9} {'min s':>9} {'':>8} {'instructions':>13} "
+        f"{'':>8} {'gc s':>8} {'max pause ms':>13} {'peak rss KiB':>13}"
+    )
+
+    for name, result in results.items():
+        base = baseline.get(name, {})
+        fastest = result["wall_seconds_min"]
+        base_fastest = base.get("wall_seconds_min")
+
+        mark = ""
+        if base_fastest and fastest > base_fastest * (1 + REGRESSION_THRESHOLD):
+            mark = " slower"
+            regressions += 1
+        elif base_fastest and fastest < base_fastest * (1 - REGRESSION_THRESHOLD):
+            mark = " faster"
+
+        print(
+            f"{name:<16} {result['wall_seconds']:>9.4f} {fastest:>9.4f} "
+            f"{format_ratio(fastest, base_fastest):>8} {result['instructions']:>13} "
+            f"{format_ratio(result['instructions'], base.get('instructions')):>8} "
+            f"{result['gc_seconds']:>8.4f} {result['max_pause_seconds'] * 1000:>13.3f} "
+            f"{result['peak_rss_bytes'] // 1024:>13}{mark}"
+        )
+
+    return regressions
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Runs the programs in benchmarks/ and compares them to a baseline."
+    )
+    parser.add_argument("names", nargs="*", help="benchmarks to run, all by default")
+    parser.add_argument("--runs", type=int, default=5, help="runs of every benchmark")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE)
+    parser.add_argument(
+        "--save", action="store_true", help="store the results as the new baseline"
+    )
+    parser.add_argument("-O", dest="optimize", action="store_true")
+    args = parser.parse_args()
+
+    results = {}
+    failed = False
+
+    for name in list_benchmarks(args.names):
+        if not full_passes(
+            DefaultErrorListener(),
+            os.path.join(BENCHMARK_FOLDER, name + ".loop"),
+            compile_imported=True,
+            optimize=args.optimize,
+        ):
+            print(f"error: {name}: compilation failed")
+            failed = True
+            continue
+
+        if result := run_benchmark(name, args.runs):
+            results[name] = result
+        else:
+            failed = True
+
+    baseline = {}
+    if not args.save and os.path.exists(args.baseline):
+        baseline = read_report(args.baseline)
+
+    regressions = print_results(results, baseline)
+
+    if args.save:
+        with open(args.baseline, "w") as file:
+            json.dump(results, file, indent=4, sort_keys=True)
+            file.write("\n")
+
+    sys.exit(1 if failed or regressions else 0)
@@ -5,14 +5,22 @@ from loop_compiler.full_passes import full_passes
 
 
 def main():
-    if len(sys.argv) != 2:
+    args = sys.argv[1:]
+    optimize = "-O" in args
+    if optimize:
+        args.remove("-O")
+
+    if len(args) != 1:
         print("error: wrong arguments count")
-        print("usage: main.py source_path")
+        print("usage: main.py [-O] source_path")
         sys.exit(2)
 
-    in_path = sys.argv[1]
+    in_path = args[0]
     if not full_passes(
-        DefaultErrorListener(), in_path + ".loop", compile_imported=True
+        DefaultErrorListener(),
+        in_path + ".loop",
+        compile_imported=True,
+        optimize=optimize,
     ):
         sys.exit(3)
 
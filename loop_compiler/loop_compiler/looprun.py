@@ -12,6 +12,7 @@ def run_and_compile_loop(path: str, **kwargs) -> Optional[Popen]:
         SilentErrorListener() if kwargs.get("silent_el") else DefaultErrorListener(),
         path + ".loop",
         compile_imported=True,
+        optimize=kwargs.get("optimize", False),
     ):
         return None
 
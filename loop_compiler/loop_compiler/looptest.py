@@ -1,5 +1,6 @@
 import os
 import re
+import sys
 
 from loop_compiler.passes.read_file import read_loop_file
 
@@ -8,6 +9,9 @@ from loop_compiler.looprun import run_and_compile_loop
 TEST_FOLDER = "looptest"
 
 if __name__ == "__main__":
+    # `looptest.py -O` runs every test with the optimized bytecode.
+    optimize = "-O" in sys.argv[1:]
+
     for i, path in enumerate(os.listdir(os.path.join(TEST_FOLDER, "fail"))):
         if not path.endswith(".loop"):
             continue
@@ -16,6 +20,7 @@ if __name__ == "__main__":
             os.path.join(TEST_FOLDER, "fail", os.path.splitext(path)[0]),
             silent_el=True,
             silent_stderr=True,
+            optimize=optimize,
         ):
             if p.returncode != 0:
                 res = True
@@ -37,6 +42,7 @@ if __name__ == "__main__":
             silent_stderr=True,
             pipe_out=True,
             silent_el=True,
+            optimize=optimize,
         ):
             if p.returncode == 0:
                 read = (
@@ -1,7 +1,8 @@
 from dataclasses import dataclass
 from typing import List, Optional
 
-from loop_compiler.util.emmiter import Emitter
+from loop_compiler.util.emmiter import Emitter, JumpTooFar
+from loop_compiler.util.default_error_listener import DeferredErrorListener
 from loop_compiler.util.error_listener import ErrorListener
 
 from loop_compiler.loop_ast.repr import *
@@ -30,6 +31,26 @@ class BaseCompiler(AstVisitor):
     def compile(self, node: AstNode):
         return self.visit(node)
 
+    def compile_root(self, node: AstNode):
+        # Messages of the first attempt are held back, the second one would report them again.
+        listener = self.error_listener
+        deferred = DeferredErrorListener()
+        self.error_listener = deferred
+        self.emitter = Emitter(deferred)
+
+        try:
+            self.compile(node)
+        except JumpTooFar:
+            # Start over with four-byte offsets in every forward jump.
+            self.error_listener = listener
+            self.emitter = Emitter(listener, wide_jumps=True)
+            self.compile(node)
+            return
+
+        self.error_listener = listener
+        self.emitter.error_listener = listener
+        deferred.replay(listener)
+
     def visit_ListLiteral(self, expr: ListLiteral):
         for item in expr.elements:
             self.compile(item)
@@ -127,6 +148,10 @@ class BaseCompiler(AstVisitor):
             self.emitter.byte(len(stmt.upvalues), stmt.pos)
 
             for upvalue in stmt.upvalues:
+                if upvalue.index > 255:
+                    self.error_listener.error(stmt.pos, "too many variables to capture")
+                    return
+
                 self.emitter.byte(1 if upvalue.is_local else 0, stmt.pos)
                 self.emitter.byte(upvalue.index, stmt.pos)
 
@@ -199,6 +224,23 @@ class BaseCompiler(AstVisitor):
         self.get_var(expr.name)
 
     def visit_CallExpr(self, expr: CallExpr):
+        match expr.callee:
+            case GetAttrExpr(_, VarExpr(_, Identifier(_, "super", _, _)), _):
+                pass
+
+            case GetAttrExpr(_, obj, attr):
+                # Method call without a bound method.
+                self.compile(obj)
+
+                for arg in expr.args:
+                    self.compile(arg)
+
+                self.emitter.add_and_process_constant(
+                    StringValue(attr.text), expr.pos, LongInst.Invoke
+                )
+                self.emitter.byte(len(expr.args), expr.pos)
+                return
+
         self.compile(expr.callee)
 
         for arg in expr.args:
@@ -302,15 +344,14 @@ class BaseCompiler(AstVisitor):
 
         match name.ref_type:
             case RefType.GLOBAL:
-                self.emitter.opcode(Opcode.SetGlobal, name.pos)
-                self.emitter.byte(name.ref_index, name.pos)
+                self.emitter.index_inst(Opcode.SetGlobal, name.ref_index, name.pos)
                 self.emitter.opcode(Opcode.Pop, name.pos)
             case RefType.EXPORT:
                 self.emitter.add_and_process_constant(
                     StringValue(name.text), name.pos, LongInst.Export
                 )
             case RefType.LOCAL:
-                pass
+                self.emitter.use_local(name.ref_index)
             case _:
                 raise NotImplementedError()
 
@@ -322,8 +363,10 @@ class BaseCompiler(AstVisitor):
                     if name.ref_type == RefType.GLOBAL
                     else Opcode.GetLocal
                 )
-                self.emitter.opcode(opcode, name.pos)
-                self.emitter.byte(name.ref_index, name.pos)
+                self.emitter.index_inst(opcode, name.ref_index, name.pos)
+
+                if name.ref_type == RefType.LOCAL:
+                    self.emitter.use_local(name.ref_index)
 
             case RefType.EXPORT:
                 self.emitter.add_and_process_constant(
@@ -345,8 +388,10 @@ class BaseCompiler(AstVisitor):
                     if name.ref_type == RefType.GLOBAL
                     else Opcode.SetLocal
                 )
-                self.emitter.opcode(opcode, name.pos)
-                self.emitter.byte(name.ref_index, name.pos)
+                self.emitter.index_inst(opcode, name.ref_index, name.pos)
+
+                if name.ref_type == RefType.LOCAL:
+                    self.emitter.use_local(name.ref_index)
 
             case RefType.EXPORT:
                 self.emitter.add_and_process_constant(
@@ -366,7 +411,7 @@ class FunctionCompiler(BaseCompiler):
         super().__init__(error_listener, path)
 
     def do(self, func: FuncDecl) -> FunctionValue:
-        self.compile(func.body)
+        self.compile_root(func.body)
 
         last_pos = make_last_pos(func.body.stmts, func.pos)
 
@@ -391,7 +436,7 @@ class ModuleCompiler(BaseCompiler):
         super().__init__(error_listener, path)
 
     def do(self, module: Module) -> Optional[ModuleValue]:
-        self.compile(module)
+        self.compile_root(module)
 
         if not self.error_listener.had_error:
             return ModuleValue(module.globals_count, self.emitter.make_chunk())
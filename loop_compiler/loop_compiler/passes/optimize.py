@@ -0,0 +1,552 @@
+from dataclasses import dataclass, field
+from typing import Dict, List, Optional, Set, Tuple
+
+from loop_compiler.loop_ast.repr import *
+
+
+# Optimizations over the emitted bytecode, enabled with `loopc -O`. Every chunk is decoded into
+# a list of instructions whose jumps point at other instructions, rewritten by a few peephole
+# passes until nothing changes and then encoded again with the smallest operands that fit.
+
+
+INDEX_OPCODES = {
+    Opcode.PushConstant,
+    Opcode.GetGlobal,
+    Opcode.SetGlobal,
+    Opcode.GetLocal,
+    Opcode.SetLocal,
+    Opcode.Export,
+    Opcode.Import,
+    Opcode.GetAttribute,
+    Opcode.SetAttribute,
+    Opcode.GetExport,
+    Opcode.SetExport,
+    Opcode.SuperGet,
+    Opcode.Invoke,
+    Opcode.SetLocalPop,
+    Opcode.SetGlobalPop,
+}
+
+CONSTANT_OPCODES = {
+    Opcode.PushConstant,
+    Opcode.Export,
+    Opcode.Import,
+    Opcode.GetAttribute,
+    Opcode.SetAttribute,
+    Opcode.GetExport,
+    Opcode.SetExport,
+    Opcode.SuperGet,
+    Opcode.Invoke,
+}
+
+BYTE_OPCODES = {
+    Opcode.BuildList,
+    Opcode.Call,
+    Opcode.BuildDictionary,
+    Opcode.GetItem,
+    Opcode.SetItem,
+    Opcode.GetUpvalue,
+    Opcode.SetUpvalue,
+    Opcode.AddLocalLocal,
+    Opcode.IncrementLocal,
+}
+
+JUMP_OPCODES = {
+    Opcode.JumpIfFalse,
+    Opcode.JumpIfTrue,
+    Opcode.JumpIfFalsePop,
+    Opcode.Jump,
+    Opcode.Loop,
+    Opcode.TryBegin,
+    Opcode.LessJumpIfFalse,
+    Opcode.LessLocalConstJumpIfFalse,
+}
+
+# Bytes that follow the first operand, they are never widened.
+EXTRA_BYTES = {
+    Opcode.Invoke: 1,
+    Opcode.AddLocalLocal: 1,
+    Opcode.IncrementLocal: 1,
+    Opcode.LessLocalConstJumpIfFalse: 2,
+}
+
+# Instructions after which execution never falls through.
+TERMINATORS = {
+    Opcode.Return,
+    Opcode.Throw,
+    Opcode.Jump,
+    Opcode.Loop,
+    Opcode.ModuleEnd,
+}
+
+FUSED_NOT = {
+    Opcode.Greater: Opcode.LessEqual,
+    Opcode.Less: Opcode.GreaterEqual,
+    Opcode.Equal: Opcode.NotEqual,
+}
+
+INT_OPERATIONS = {
+    Opcode.Add: lambda a, b: a + b,
+    Opcode.Subtract: lambda a, b: a - b,
+    Opcode.Multiply: lambda a, b: a * b,
+    # Truncates toward zero like C.
+    Opcode.Divide: lambda a, b: abs(a) // abs(b) * (1 if (a < 0) == (b < 0) else -1),
+    Opcode.Greater: lambda a, b: a > b,
+    Opcode.Less: lambda a, b: a < b,
+    Opcode.Equal: lambda a, b: a == b,
+    Opcode.LessEqual: lambda a, b: a <= b,
+    Opcode.GreaterEqual: lambda a, b: a >= b,
+    Opcode.NotEqual: lambda a, b: a != b,
+}
+
+
+@dataclass(eq=False)
+class Instruction:
+    opcode: Optional[Opcode]
+    line: int
+    arg: int = 0
+    # The EXTRA_BYTES of the opcode or the (is_local, index) bytes of BuildClosure.
+    extra: List[int] = field(default_factory=list)
+    target: Optional["Instruction"] = None
+
+
+def optimize_module(module: ModuleValue) -> ModuleValue:
+    optimize_chunk(module.script)
+    return module
+
+
+def optimize_chunk(chunk: Chunk):
+    for constant in chunk.constants:
+        match constant:
+            case FunctionValue():
+                optimize_chunk(constant.body)
+            case ClassValue():
+                for method in constant.methods:
+                    optimize_chunk(method.body)
+
+    insts = decode(chunk)
+
+    while run_passes(insts, chunk.constants):
+        pass
+
+    remove_unused_constants(insts, chunk)
+    fuse_superinstructions(insts, chunk.constants)
+    chunk.code, chunk.lines = encode(insts)
+
+
+def run_passes(insts: List[Instruction], constants: List[Value]) -> bool:
+    changed = False
+    changed |= fold_constants(insts, constants)
+    changed |= fuse_instructions(insts)
+    changed |= thread_jumps(insts)
+    changed |= remove_dead_code(insts)
+    changed |= remove_useless_jumps(insts)
+    return changed
+
+
+def decode(chunk: Chunk) -> List[Instruction]:
+    code = chunk.code
+    insts: List[Instruction] = []
+    by_offset: Dict[int, Instruction] = {}
+    # (instruction, absolute offset of the target) to be resolved once everything is decoded.
+    jumps: List[Tuple[Instruction, int]] = []
+
+    line_runs = list(chunk.lines)
+    run = 0
+
+    offset = 0
+    while offset < len(code):
+        while run + 1 < len(line_runs) and line_runs[run + 1][0] <= offset:
+            run += 1
+
+        start = offset
+        wide = code[offset] == Opcode.Wide.value
+        if wide:
+            offset += 1
+
+        opcode = Opcode(code[offset])
+        offset += 1
+
+        inst = Instruction(opcode, line_runs[run][1] if line_runs else 0)
+
+        if opcode in INDEX_OPCODES:
+            size = 2 if wide else 1
+            inst.arg = int.from_bytes(code[offset : offset + size], "little")
+            offset += size
+        elif opcode in BYTE_OPCODES:
+            inst.arg = code[offset]
+            offset += 1
+        elif opcode in JUMP_OPCODES:
+            size = 4 if wide else 2
+            jump = int.from_bytes(code[offset : offset + size], "little")
+            offset += size
+        elif opcode == Opcode.BuildClosure:
+            inst.arg = code[offset]
+            inst.extra = code[offset + 1 : offset + 1 + 2 * inst.arg]
+            offset += 1 + 2 * inst.arg
+
+        if opcode in EXTRA_BYTES:
+            inst.extra = code[offset : offset + EXTRA_BYTES[opcode]]
+            offset += EXTRA_BYTES[opcode]
+
+        # Jump offsets are counted from the end of the whole instruction.
+        if opcode in JUMP_OPCODES:
+            jumps.append((inst, offset - jump if opcode == Opcode.Loop else offset + jump))
+
+        by_offset[start] = inst
+        insts.append(inst)
+
+    # Jumps past the last instruction land on this sentinel, it is never encoded.
+    end = Instruction(None, insts[-1].line if insts else 0)
+    by_offset[len(code)] = end
+    insts.append(end)
+
+    for inst, target in jumps:
+        inst.target = by_offset[target]
+
+    return insts
+
+
+def encode(insts: List[Instruction]) -> Tuple[List[int], List[Tuple[int, int]]]:
+    wide: Set[int] = set()
+
+    # Growing a jump moves the code after it, so repeat until every offset fits.
+    while True:
+        offsets: Dict[int, int] = {}
+        offset = 0
+        for inst in insts:
+            offsets[id(inst)] = offset
+            offset += instruction_size(inst, id(inst) in wide)
+
+        grown = False
+        for inst in insts:
+            if inst.target and id(inst) not in wide:
+                after = offsets[id(inst)] + instruction_size(inst, False)
+                if abs(offsets[id(inst.target)] - after) > 0xFFFF:
+                    wide.add(id(inst))
+                    grown = True
+
+        if not grown:
+            break
+
+    code: List[int] = []
+    lines: List[Tuple[int, int]] = []
+
+    for inst in insts:
+        if inst.opcode is None:
+            continue
+
+        if not lines or lines[-1][1] != inst.line:
+            lines.append((len(code), inst.line))
+
+        is_wide = id(inst) in wide
+        opcode = inst.opcode
+
+        if inst.target:
+            after = offsets[id(inst)] + instruction_size(inst, is_wide)
+            jump = offsets[id(inst.target)] - after
+
+            # Threading may turn a forward jump into a backward one and the other way around.
+            if opcode in (Opcode.Jump, Opcode.Loop):
+                opcode = Opcode.Jump if jump >= 0 else Opcode.Loop
+
+            if is_wide:
+                code += [Opcode.Wide.value, opcode.value]
+                code += abs(jump).to_bytes(4, "little")
+            else:
+                code.append(opcode.value)
+                code += abs(jump).to_bytes(2, "little")
+            code += inst.extra
+        elif opcode in INDEX_OPCODES:
+            if inst.arg > 0xFF:
+                code += [Opcode.Wide.value, opcode.value]
+                code += inst.arg.to_bytes(2, "little")
+            else:
+                code += [opcode.value, inst.arg]
+            code += inst.extra
+        elif opcode in BYTE_OPCODES or opcode == Opcode.BuildClosure:
+            code += [opcode.value, inst.arg]
+            code += inst.extra
+        else:
+            code.append(opcode.value)
+
+    return code, lines
+
+
+def instruction_size(inst: Instruction, wide: bool) -> int:
+    if inst.opcode is None:
+        return 0
+    if inst.target:
+        return (6 if wide else 3) + len(inst.extra)
+    if inst.opcode in INDEX_OPCODES:
+        return (4 if inst.arg > 0xFF else 2) + len(inst.extra)
+    if inst.opcode in BYTE_OPCODES or inst.opcode == Opcode.BuildClosure:
+        return 2 + len(inst.extra)
+    return 1
+
+
+def jump_targets(insts: List[Instruction]) -> Set[int]:
+    return {id(inst.target) for inst in insts if inst.target}
+
+
+def int_constant(inst: Instruction, constants: List[Value]) -> Optional[int]:
+    if inst.opcode == Opcode.PushConstant:
+        constant = constants[inst.arg]
+        if isinstance(constant, IntegerValue):
+            return constant.num
+    return None
+
+
+def add_constant(constants: List[Value], value: Value) -> int:
+    for i, constant in enumerate(constants):
+        if constant == value:
+            return i
+
+    constants.append(value)
+    return len(constants) - 1
+
+
+def fold_constants(insts: List[Instruction], constants: List[Value]) -> bool:
+    changed = False
+    targets = jump_targets(insts)
+
+    i = 0
+    while i < len(insts):
+        a = insts[i]
+
+        # Only the first instruction of a folded sequence may be jumped to, it is rewritten
+        # in place so the jumps stay valid.
+        def untargeted(count: int) -> bool:
+            return i + count < len(insts) and all(
+                id(inst) not in targets for inst in insts[i + 1 : i + count + 1]
+            )
+
+        lhs = int_constant(a, constants)
+
+        if lhs is not None and untargeted(2):
+            rhs = int_constant(insts[i + 1], constants)
+            op = insts[i + 2].opcode
+
+            if rhs is not None and op in INT_OPERATIONS:
+                if not (op == Opcode.Divide and rhs == 0):
+                    result = INT_OPERATIONS[op](lhs, rhs)
+
+                    if isinstance(result, bool):
+                        a.opcode = Opcode.PushTrue if result else Opcode.PushFalse
+                        a.arg = 0
+                        del insts[i + 1 : i + 3]
+                        changed = True
+                        continue
+
+                    if INT_MIN <= result <= INT_MAX:
+                        a.arg = add_constant(constants, IntegerValue(result))
+                        del insts[i + 1 : i + 3]
+                        changed = True
+                        continue
+
+        if lhs is not None and untargeted(1) and insts[i + 1].opcode == Opcode.Negate:
+            if -lhs <= INT_MAX:
+                a.arg = add_constant(constants, IntegerValue(-lhs))
+                del insts[i + 1]
+                changed = True
+                continue
+
+        if a.opcode in (Opcode.PushTrue, Opcode.PushFalse) and untargeted(1):
+            match insts[i + 1].opcode:
+                case Opcode.Not:
+                    a.opcode = (
+                        Opcode.PushFalse if a.opcode == Opcode.PushTrue else Opcode.PushTrue
+                    )
+                    del insts[i + 1]
+                    changed = True
+                    continue
+                case Opcode.JumpIfFalsePop:
+                    # `while true` and friends: the condition is known.
+                    if a.opcode == Opcode.PushTrue:
+                        a.opcode = Opcode.Jump
+                        a.target = insts[i + 2]
+                    else:
+                        a.opcode = Opcode.Jump
+                        a.target = insts[i + 1].target
+                    del insts[i + 1]
+                    changed = True
+                    continue
+
+        i += 1
+
+    return changed
+
+
+def fuse_instructions(insts: List[Instruction]) -> bool:
+    changed = False
+    targets = jump_targets(insts)
+
+    i = 0
+    while i + 1 < len(insts):
+        a, b = insts[i], insts[i + 1]
+
+        if a.opcode in FUSED_NOT and b.opcode == Opcode.Not and id(b) not in targets:
+            a.opcode = FUSED_NOT[a.opcode]
+            del insts[i + 1]
+            changed = True
+            continue
+
+        # `x = value;` followed by a read of x keeps the value on the stack instead.
+        if (
+            a.opcode in (Opcode.SetGlobal, Opcode.SetLocal)
+            and b.opcode == Opcode.Pop
+            and i + 2 < len(insts)
+            and insts[i + 2].opcode
+            == (Opcode.GetGlobal if a.opcode == Opcode.SetGlobal else Opcode.GetLocal)
+            and insts[i + 2].arg == a.arg
+            and id(b) not in targets
+            and id(insts[i + 2]) not in targets
+        ):
+            del insts[i + 1 : i + 3]
+            changed = True
+            continue
+
+        i += 1
+
+    return changed
+
+
+def thread_jumps(insts: List[Instruction]) -> bool:
+    changed = False
+    position = {id(inst): i for i, inst in enumerate(insts)}
+
+    for i, inst in enumerate(insts):
+        if not inst.target or inst.opcode == Opcode.TryBegin:
+            continue
+
+        target = inst.target
+        seen = {id(inst)}
+
+        while target.opcode in (Opcode.Jump, Opcode.Loop) and id(target) not in seen:
+            seen.add(id(target))
+            # Conditional jumps are only encoded forward.
+            if inst.opcode not in (Opcode.Jump, Opcode.Loop) and position[id(target.target)] <= i:
+                break
+            target = target.target
+
+        if target is not inst.target:
+            inst.target = target
+            changed = True
+
+    return changed
+
+
+def remove_dead_code(insts: List[Instruction]) -> bool:
+    changed = False
+    targets = jump_targets(insts)
+
+    i = 0
+    while i + 1 < len(insts):
+        if insts[i].opcode in TERMINATORS:
+            end = i + 1
+            while insts[end].opcode is not None and id(insts[end]) not in targets:
+                end += 1
+
+            if end > i + 1:
+                del insts[i + 1 : end]
+                changed = True
+                # Removed jumps may have been the only way into the code that follows.
+                targets = jump_targets(insts)
+
+        i += 1
+
+    return changed
+
+
+def remove_useless_jumps(insts: List[Instruction]) -> bool:
+    changed = False
+
+    i = 0
+    while i + 1 < len(insts):
+        inst = insts[i]
+
+        if inst.opcode == Opcode.Jump and inst.target is insts[i + 1]:
+            # Whatever jumped here now lands on the next instruction.
+            for other in insts:
+                if other.target is inst:
+                    other.target = insts[i + 1]
+
+            del insts[i]
+            changed = True
+            continue
+
+        i += 1
+
+    return changed
+
+
+def fuse_superinstructions(insts: List[Instruction], constants: List[Value]):
+    # The sequences were picked by counting executed opcode pairs over looptest and the
+    # numeric benchmarks. Superinstructions take byte operands only, so sequences with a
+    # wide index stay as they are.
+    targets = jump_targets(insts)
+
+    def matches(i: int, *opcodes: Opcode) -> bool:
+        return (
+            i + len(opcodes) <= len(insts)
+            and all(inst.opcode == op for inst, op in zip(insts[i:], opcodes))
+            and all(id(inst) not in targets for inst in insts[i + 1 : i + len(opcodes)])
+        )
+
+    def small_int(inst: Instruction) -> bool:
+        return inst.arg <= 0xFF and int_constant(inst, constants) is not None
+
+    i = 0
+    while i < len(insts):
+        a = insts[i]
+
+        # i = i + k;
+        if (
+            matches(i, Opcode.GetLocal, Opcode.PushConstant, Opcode.Add, Opcode.SetLocal, Opcode.Pop)
+            and a.arg <= 0xFF
+            and small_int(insts[i + 1])
+            and insts[i + 3].arg == a.arg
+        ):
+            a.opcode, a.extra = Opcode.IncrementLocal, [insts[i + 1].arg]
+            del insts[i + 1 : i + 5]
+
+        # while i < k {
+        elif (
+            matches(i, Opcode.GetLocal, Opcode.PushConstant, Opcode.Less, Opcode.JumpIfFalsePop)
+            and a.arg <= 0xFF
+            and small_int(insts[i + 1])
+        ):
+            a.opcode, a.extra = Opcode.LessLocalConstJumpIfFalse, [a.arg, insts[i + 1].arg]
+            a.arg, a.target = 0, insts[i + 3].target
+            del insts[i + 1 : i + 4]
+
+        elif matches(i, Opcode.GetLocal, Opcode.GetLocal, Opcode.Add) and max(
+            a.arg, insts[i + 1].arg
+        ) <= 0xFF:
+            a.opcode, a.extra = Opcode.AddLocalLocal, [insts[i + 1].arg]
+            del insts[i + 1 : i + 3]
+
+        elif matches(i, Opcode.Less, Opcode.JumpIfFalsePop):
+            a.opcode, a.target = Opcode.LessJumpIfFalse, insts[i + 1].target
+            del insts[i + 1]
+
+        elif matches(i, Opcode.SetLocal, Opcode.Pop):
+            a.opcode = Opcode.SetLocalPop
+            del insts[i + 1]
+
+        elif matches(i, Opcode.SetGlobal, Opcode.Pop):
+            a.opcode = Opcode.SetGlobalPop
+            del insts[i + 1]
+
+        i += 1
+
+
+def remove_unused_constants(insts: List[Instruction], chunk: Chunk):
+    used = sorted({inst.arg for inst in insts if inst.opcode in CONSTANT_OPCODES})
+    remap = {old: new for new, old in enumerate(used)}
+
+    for inst in insts:
+        if inst.opcode in CONSTANT_OPCODES:
+            inst.arg = remap[inst.arg]
+
+    chunk.constants = [chunk.constants[old] for old in used]
@@ -18,6 +18,7 @@ from loop_compiler.loop_ast.expr import (
     VarExpr,
 )
 from loop_compiler.loop_ast.module import Module
+from loop_compiler.loop_ast.repr import INT_MAX
 from loop_compiler.loop_ast.loop_patterns import IdentifierPattern, ListPattern, Pattern
 from loop_compiler.loop_ast.stmt import (
     BlockStmt,
@@ -275,6 +276,7 @@ class SemanticCheck(AstVisitor):
     classes: List[ClassDef]
     loops: List[Loop]
     compile_imported: bool
+    optimize: bool
 
     def __init__(self, file: File, error_listener: ErrorListener, **kwargs):
         self.file = file
@@ -283,6 +285,7 @@ class SemanticCheck(AstVisitor):
         self.classes = []
         self.loops = []
         self.compile_imported = kwargs.get("compile_imported", False)
+        self.optimize = kwargs.get("optimize", False)
 
     def check(self, node: AstNode):
         self.visit(node)
@@ -314,7 +317,13 @@ class SemanticCheck(AstVisitor):
         )
 
         if self.compile_imported:
-            full_passes(self.error_listener, path + ".loop", pos)
+            full_passes(
+                self.error_listener,
+                path + ".loop",
+                pos,
+                compile_imported=True,
+                optimize=self.optimize,
+            )
         else:
             # TODO: Full passes has a check of times. But str to loop module not.
             if file := read_loop_file(resolve_path(path + ".loop")):
@@ -533,7 +542,9 @@ class SemanticCheck(AstVisitor):
             self.check(pair.value)
 
     def visit_IntegerLiteral(self, expr: IntegerLiteral):
-        pass
+        # A minus sign is a separate operator, so the literal itself is never negative.
+        if expr.num > INT_MAX:
+            self.error_listener.error(expr.pos, "integer literal out of range")
 
     def visit_BoolLiteral(self, expr: BoolLiteral):
         pass
@@ -0,0 +1,137 @@
+from typing import Dict, List
+
+from loop_compiler.loop_ast.repr import *
+from loop_compiler.passes.optimize import TERMINATORS, Instruction, decode
+
+
+# Every chunk records how many stack slots its frame takes at most, the callee, the arguments,
+# the locals and the temporaries of expressions. loopvm reserves them when the frame is pushed.
+# The depth is found on the final bytecode, so it holds for the code `loopc -O` rewrites as well.
+
+
+# Slots an instruction leaves on the stack minus the ones it takes, for the opcodes whose effect
+# does not depend on the operand.
+STACK_EFFECTS = {
+    Opcode.Return: -1,
+    Opcode.PushConstant: 1,
+    Opcode.Negate: 0,
+    Opcode.Add: -1,
+    Opcode.Subtract: -1,
+    Opcode.Multiply: -1,
+    Opcode.Divide: -1,
+    Opcode.Print: -1,
+    Opcode.Pop: -1,
+    Opcode.Plus: 0,
+    Opcode.Equal: -1,
+    Opcode.Not: 0,
+    Opcode.JumpIfFalse: 0,
+    Opcode.JumpIfTrue: 0,
+    Opcode.PushTrue: 1,
+    Opcode.PushFalse: 1,
+    Opcode.Greater: -1,
+    Opcode.Less: -1,
+    Opcode.PushNull: 1,
+    Opcode.GetGlobal: 1,
+    Opcode.SetGlobal: 0,
+    Opcode.GetLocal: 1,
+    Opcode.SetLocal: 0,
+    Opcode.JumpIfFalsePop: -1,
+    Opcode.Jump: 0,
+    Opcode.Loop: 0,
+    Opcode.Export: -1,
+    Opcode.Import: 1,
+    Opcode.Top: 1,
+    Opcode.GetAttribute: 0,
+    Opcode.ModuleEnd: -1,
+    Opcode.SetAttribute: -1,
+    Opcode.GetExport: 1,
+    Opcode.SetExport: 0,
+    Opcode.BuildClosure: 0,
+    Opcode.GetUpvalue: 1,
+    Opcode.SetUpvalue: 0,
+    Opcode.CloseUpvalue: -1,
+    Opcode.Inherit: -1,
+    Opcode.SuperGet: 1,
+    Opcode.TryBegin: 0,
+    Opcode.TryEnd: 0,
+    Opcode.Throw: -1,
+    Opcode.InstanceOf: -1,
+    Opcode.LessEqual: -1,
+    Opcode.GreaterEqual: -1,
+    Opcode.NotEqual: -1,
+    Opcode.SetLocalPop: -1,
+    Opcode.SetGlobalPop: -1,
+    Opcode.AddLocalLocal: 1,
+    Opcode.IncrementLocal: 0,
+    Opcode.LessJumpIfFalse: -2,
+    Opcode.LessLocalConstJumpIfFalse: 0,
+}
+
+
+def stack_effect(inst: Instruction) -> int:
+    match inst.opcode:
+        case Opcode.BuildList:
+            return 1 - inst.arg
+        case Opcode.BuildDictionary:
+            return 1 - 2 * inst.arg
+        # The callee or the container, then the operands, are replaced by the result.
+        case Opcode.Call | Opcode.GetItem | Opcode.SetItem:
+            return -inst.arg
+        case Opcode.Invoke:
+            return -inst.extra[0]
+        case opcode:
+            return STACK_EFFECTS[opcode]
+
+
+def set_stack_sizes(module: ModuleValue) -> ModuleValue:
+    # The script sits in the first slot of its frame.
+    set_chunk_stack_size(module.script, 1)
+    return module
+
+
+def set_chunk_stack_size(chunk: Chunk, base: int):
+    for constant in chunk.constants:
+        match constant:
+            case FunctionValue():
+                set_chunk_stack_size(constant.body, constant.arity + 1)
+            case ClassValue():
+                for method in constant.methods:
+                    set_chunk_stack_size(method.body, method.arity + 1)
+
+    chunk.stack_size = max(max_depth(decode(chunk), base), chunk.locals_count)
+
+
+def max_depth(insts: List[Instruction], base: int) -> int:
+    if not insts:
+        return base
+
+    index = {id(inst): i for i, inst in enumerate(insts)}
+    # Depth before every instruction that was reached. Each one is entered with the same depth
+    # from every path, so an instruction is visited once.
+    depths: Dict[int, int] = {0: base}
+    pending = [0]
+    deepest = base
+
+    while pending:
+        i = pending.pop()
+        inst = insts[i]
+        if inst.opcode is None:
+            continue
+
+        after = depths[i] + stack_effect(inst)
+        deepest = max(deepest, after)
+
+        successors = []
+        if inst.opcode not in TERMINATORS:
+            successors.append((i + 1, after))
+        if inst.target:
+            # The handler of a try gets the thrown value on the stack of the TryBegin.
+            target_depth = after + 1 if inst.opcode == Opcode.TryBegin else after
+            successors.append((index[id(inst.target)], target_depth))
+
+        for successor, depth in successors:
+            if successor not in depths:
+                depths[successor] = depth
+                pending.append(successor)
+
+    return max(deepest, max(depths.values()))
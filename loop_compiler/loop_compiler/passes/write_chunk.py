@@ -3,14 +3,23 @@ import json
 import os
 
 from loop_compiler.loop_ast.repr import *
+from loop_compiler.util.binary_writer import BinaryWriter
 
 
-def write_chunk(path: str, module: ModuleValue) -> bool:
+def write_chunk(path: str, module: ModuleValue, binary: bool = True) -> bool:
     # print(f"WRITING CurDir: {os.getcwd()} Path: {path} | dirname: {os.path.dirname(path)}")
 
     if (dir := os.path.dirname(path)) != "":
         os.makedirs(dir, exist_ok=True)
 
+    if binary:
+        writer = BinaryWriter()
+        module.write_binary_object_data(writer)
+
+        with open(path, "wb") as fout:
+            fout.write(writer.data)
+            return True
+
     with open(path, "w") as fout:
         fout.write(json.dumps(module.make_json_object_data(), indent=4))
         return True
@@ -0,0 +1,32 @@
+import struct
+
+
+class BinaryWriter:
+    """Little-endian writer for the binary .code format (see loopvm Bytecode.h)."""
+
+    data: bytearray
+
+    def __init__(self) -> None:
+        self.data = bytearray()
+
+    def u8(self, value: int):
+        self.data += struct.pack("<B", value)
+
+    def u32(self, value: int):
+        self.data += struct.pack("<I", value)
+
+    def i64(self, value: int):
+        self.data += struct.pack("<q", value)
+
+    def raw(self, data: bytes):
+        self.data += data
+
+    def string(self, text: str):
+        encoded = text.encode()
+        self.u32(len(encoded))
+        self.raw(encoded)
+
+    def align(self, alignment: int):
+        # The VM maps the file and uses tables in place, so they must be aligned in the file.
+        while len(self.data) % alignment != 0:
+            self.u8(0)
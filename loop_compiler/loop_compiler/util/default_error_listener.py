@@ -1,4 +1,4 @@
-from typing import Optional
+from typing import List, Optional, Tuple
 
 from loop_compiler.loop_ast.base import SourcePosition
 from loop_compiler.util.error_listener import ErrorListener
@@ -29,3 +29,26 @@ class SilentErrorListener(ErrorListener):
 
     error_impl = silent
     note = silent
+
+
+class DeferredErrorListener(ErrorListener):
+    """Keeps the messages until they are replayed, so a pass that is run again can drop them."""
+
+    messages: List[Tuple[str, Optional[SourcePosition], str]]
+
+    def __init__(self) -> None:
+        super().__init__()
+        self.messages = []
+
+    def error_impl(self, pos: Optional[SourcePosition], msg: str):
+        self.messages.append(("error", pos, msg))
+
+    def note(self, pos: Optional[SourcePosition], msg: str):
+        self.messages.append(("note", pos, msg))
+
+    def replay(self, target: ErrorListener):
+        for kind, pos, msg in self.messages:
+            if kind == "error":
+                target.error(pos, msg)
+            else:
+                target.note(pos, msg)
@@ -1,4 +1,4 @@
-from typing import List
+from typing import List, Tuple
 
 from loop_compiler.util.error_listener import ErrorListener
 from loop_compiler.loop_ast.base import SourcePosition
@@ -6,17 +6,25 @@ from loop_compiler.loop_ast.base import SourcePosition
 from loop_compiler.loop_ast.repr import Chunk, LongInst, Opcode, Value
 
 
+class JumpTooFar(Exception):
+    """A forward jump does not fit in two bytes, the code has to be emitted again with wide_jumps."""
+
+
 class Emitter:
     error_listener: ErrorListener
     code: List[int]
     constants: List[Value]
-    lines: List[int]
+    lines: List[Tuple[int, int]]
+    locals_count: int
+    wide_jumps: bool
 
-    def __init__(self, error_listener: ErrorListener) -> None:
+    def __init__(self, error_listener: ErrorListener, wide_jumps: bool = False) -> None:
         self.error_listener = error_listener
         self.code = []
         self.constants = []
-        self.lines = [0]
+        self.lines = []
+        self.locals_count = 0
+        self.wide_jumps = wide_jumps
 
     def get_pos(self) -> int:
         return len(self.code)
@@ -32,7 +40,7 @@ class Emitter:
         self.constants.append(value)
         index = len(self.constants) - 1
 
-        if index > 255:
+        if index > 0xFFFF:
             self.error_listener.error(pos, "too many constants")
 
         return index
@@ -59,54 +67,87 @@ class Emitter:
                 self.long_inst_impl(index, pos, [Opcode.SetExport])
             case LongInst.SuperGet:
                 self.long_inst_impl(index, pos, [Opcode.SuperGet])
+            case LongInst.Invoke:
+                self.long_inst_impl(index, pos, [Opcode.Invoke])
             case _:
                 raise Exception("not implemented long_inst")
 
     def long_inst_impl(self, index: int, pos: SourcePosition, lst: List[Opcode]):
-        # There is no check for correctness.
+        self.index_inst(lst[0], index, pos)
 
+    def index_inst(self, opcode: Opcode, index: int, pos: SourcePosition):
+        # Indices past a byte get the Wide prefix and two bytes.
         if index < 256:
-            self.opcode(lst[0], pos)
+            self.opcode(opcode, pos)
             self.byte(index, pos)
+        elif index <= 0xFFFF:
+            self.opcode(Opcode.Wide, pos)
+            self.opcode(opcode, pos)
+            self.short(index, pos)
+        else:
+            self.error_listener.error(pos, "operand is too big")
+
+    def use_local(self, index: int):
+        self.locals_count = max(self.locals_count, index + 1)
 
     def jump(self, opcode: Opcode, pos: SourcePosition) -> int:
-        self.opcode(opcode, pos)
-        self.byte(0xFF, pos)
-        self.byte(0xFF, pos)
+        index = len(self.code)
 
-        return len(self.code) - 3
+        if self.wide_jumps:
+            self.opcode(Opcode.Wide, pos)
+            self.opcode(opcode, pos)
+            self.long(0xFFFFFFFF, pos)
+        else:
+            self.opcode(opcode, pos)
+            self.short(0xFFFF, pos)
+
+        return index
 
     def loop(self, index: int, pos: SourcePosition):
-        # TODO: Generalize with patch_jump?
+        # The offset is counted from the end of the instruction.
         jump = len(self.code) - index + 3
-        if jump > 0xFFFF:
-            self.error_listener.error(pos, "jump is too far")
 
-        self.opcode(Opcode.Loop, pos)
-        self.byte(jump & 0xFF, pos)
-        self.byte((jump >> 8) & 0xFF, pos)
+        if jump <= 0xFFFF:
+            self.opcode(Opcode.Loop, pos)
+            self.short(jump, pos)
+        else:
+            self.opcode(Opcode.Wide, pos)
+            self.opcode(Opcode.Loop, pos)
+            self.long(jump + 3, pos)
 
     def patch_jump(self, index: int, pos: SourcePosition):
         assert index < len(self.code)
-        assert index + 3 <= len(self.code)
 
-        jump = len(self.code) - index - 3
-        if jump > 0xFFFF:
-            self.error_listener.error(pos, "jump is too far")
+        if self.code[index] == Opcode.Wide.value:
+            assert index + 6 <= len(self.code)
+
+            jump = len(self.code) - index - 6
+            self.code[index + 2 : index + 6] = jump.to_bytes(4, "little")
+        else:
+            assert index + 3 <= len(self.code)
+
+            jump = len(self.code) - index - 3
+            if jump > 0xFFFF:
+                raise JumpTooFar()
 
-        # TODO: Endianess bug?
-        self.code[index + 1] = jump & 0xFF
-        self.code[index + 2] = (jump >> 8) & 0xFF
+            self.code[index + 1 : index + 3] = jump.to_bytes(2, "little")
 
     def byte(self, byte: int, pos: SourcePosition):
         assert type(byte) == int and byte >= 0 and byte < 256
 
+        # A new (offset, line) run starts whenever the line changes.
+        if not self.lines or self.lines[-1][1] != pos.start.line:
+            self.lines.append((len(self.code), pos.start.line))
+
         self.code.append(byte)
 
-        if pos.start.line == len(self.lines) - 1:
-            self.lines[-1] += 1
-        else:
-            self.lines.append(0)
+    def short(self, value: int, pos: SourcePosition):
+        for byte in value.to_bytes(2, "little"):
+            self.byte(byte, pos)
+
+    def long(self, value: int, pos: SourcePosition):
+        for byte in value.to_bytes(4, "little"):
+            self.byte(byte, pos)
 
     def make_chunk(self) -> Chunk:
-        return Chunk(self.code, self.constants, self.lines)
+        return Chunk(self.code, self.constants, self.lines, self.locals_count)
@@ -2,6 +2,7 @@ from setuptools import find_packages, setup
 
 setup(
     name="loop_compiler",
-    scripts=["loop_compiler/loopc.py", "loop_compiler/looprun.py", "loop_compiler/looptest.py"],
+    scripts=["loop_compiler/loopc.py", "loop_compiler/looprun.py", "loop_compiler/looptest.py",
+             "loop_compiler/loopbench.py"],
     packages=find_packages(),
 )
@@ -0,0 +1,52 @@
+#include "Bytecode.h"
+
+bool BytecodeIsBinary(const uint8_t *data, size_t size) {
+    return size >= BYTECODE_MAGIC_LENGTH && memcmp(data, BYTECODE_MAGIC, BYTECODE_MAGIC_LENGTH) == 0;
+}
+
+void BytecodeReaderInit(BytecodeReader *self, const uint8_t *data, size_t size) {
+    self->start = data;
+    self->ptr = data;
+    self->end = data + size;
+    self->failed = false;
+}
+
+const uint8_t *BytecodeReadBytes(BytecodeReader *self, size_t count) {
+    if (self->failed || count > (size_t) (self->end - self->ptr)) {
+        self->failed = true;
+        return NULL;
+    }
+
+    const uint8_t *res = self->ptr;
+    self->ptr += count;
+    return res;
+}
+
+uint8_t BytecodeReadU8(BytecodeReader *self) {
+    const uint8_t *bytes = BytecodeReadBytes(self, 1);
+    return bytes == NULL ? 0 : bytes[0];
+}
+
+uint32_t BytecodeReadU32(BytecodeReader *self) {
+    const uint8_t *bytes = BytecodeReadBytes(self, 4);
+    if (bytes == NULL) {
+        return 0;
+    }
+
+    return (uint32_t) bytes[0]
+           | (uint32_t) bytes[1] << 8
+           | (uint32_t) bytes[2] << 16
+           | (uint32_t) bytes[3] << 24;
+}
+
+int64_t BytecodeReadI64(BytecodeReader *self) {
+    const uint64_t low = BytecodeReadU32(self);
+    const uint64_t high = BytecodeReadU32(self);
+    return (int64_t) (low | high << 32);
+}
+
+void BytecodeReadAlign(BytecodeReader *self, size_t alignment) {
+    size_t offset = self->ptr - self->start;
+    size_t padding = (alignment - offset % alignment) % alignment;
+    BytecodeReadBytes(self, padding);
+}
@@ -0,0 +1,54 @@
+#ifndef LOOP_BYTECODE_H
+#define LOOP_BYTECODE_H
+
+#include "Common.h"
+
+// Binary .code format, written by write_chunk.py. All numbers are little-endian.
+//
+// Module:   "LOOP" u32:version u32:globals_count Chunk
+// Chunk:    u32:code_length u32:lines_length u32:constants_count u32:locals_count u32:stack_size
+//           u8[code_length] <pad to 4> ChunkLine[lines_length] Constant[constants_count]
+// ChunkLine: u32:offset u32:line
+// Constant: u8:BytecodeType, then
+//           Integer:  i64
+//           String:   u32:length u8[length]
+//           Function: String:name u32:arity Chunk
+//           Class:    String:name u32:methods_count Function[methods_count] (without the type byte)
+//
+// The file is mapped into memory and code and line tables are used in place.
+
+#define BYTECODE_MAGIC "LOOP"
+#define BYTECODE_MAGIC_LENGTH 4
+#define BYTECODE_VERSION 5
+
+typedef enum BytecodeType {
+    BytecodeType_Integer,
+    BytecodeType_String,
+    BytecodeType_Function,
+    BytecodeType_Class,
+} BytecodeType;
+
+/// Every read is bounds checked. Reading past the end sets failed and returns zeroes.
+typedef struct BytecodeReader {
+    const uint8_t *start;
+    const uint8_t *ptr;
+    const uint8_t *end;
+    bool failed;
+} BytecodeReader;
+
+bool BytecodeIsBinary(const uint8_t *data, size_t size);
+
+void BytecodeReaderInit(BytecodeReader *self, const uint8_t *data, size_t size);
+
+uint8_t BytecodeReadU8(BytecodeReader *self);
+
+uint32_t BytecodeReadU32(BytecodeReader *self);
+
+int64_t BytecodeReadI64(BytecodeReader *self);
+
+/// Returns a pointer into the data or NULL on failure.
+const uint8_t *BytecodeReadBytes(BytecodeReader *self, size_t count);
+
+void BytecodeReadAlign(BytecodeReader *self, size_t alignment);
+
+#endif // LOOP_BYTECODE_H
@@ -8,7 +8,7 @@ static void PushCode(Chunk *self, VirtualMachine *vm, uint8_t byte);
 
 static void PushConstant(Chunk *self, VirtualMachine *vm, Value value);
 
-static void PushLine(Chunk *self, VirtualMachine *vm, size_t line);
+static void PushLine(Chunk *self, VirtualMachine *vm, ChunkLine line);
 
 void ChunkInit(Chunk *self) {
     self->code = NULL;
@@ -20,12 +20,27 @@ void ChunkInit(Chunk *self) {
     self->lines = NULL;
     self->lines_length = 0;
     self->lines_capacity = 0;
+    self->locals_count = 0;
+    self->stack_size = 0;
+    self->mapped = false;
+    self->caches = NULL;
 }
 
 void ChunkDeinit(Chunk *self, VirtualMachine *vm) {
-    FREE_ARRAY(vm, self->code, uint8_t, self->code_capacity);
+    if (!self->mapped) {
+        FREE_ARRAY(vm, self->code, uint8_t, self->code_capacity);
+        FREE_ARRAY(vm, self->lines, ChunkLine, self->lines_capacity);
+    }
+
+    if (self->caches != NULL) {
+        for (size_t i = 0; i < self->constants_length; ++i) {
+            FREE_ARRAY(vm, self->caches[i], InlineCache, 1);
+        }
+
+        FREE_ARRAY(vm, self->caches, InlineCache *, self->constants_length);
+    }
+
     FREE_ARRAY(vm, self->constants, Value, self->constants_capacity);
-    FREE_ARRAY(vm, self->lines, size_t, self->lines_capacity);
     ChunkInit(self);
 }
 
@@ -50,13 +65,58 @@ void ChunkFromJSON(Chunk *self, VirtualMachine *vm, ObjectModule *module, const
         PushConstant(self, vm, ValueFromJSON(vm, module, constant));
     }
 
+    const cJSON *locals_count = cJSON_GetObjectItemCaseSensitive(json, "locals_count");
+    assert(cJSON_IsNumber(locals_count));
+    self->locals_count = locals_count->valueint;
+
+    const cJSON *stack_size = cJSON_GetObjectItemCaseSensitive(json, "stack_size");
+    assert(cJSON_IsNumber(stack_size));
+    self->stack_size = stack_size->valueint;
+
     const cJSON *lines = cJSON_GetObjectItemCaseSensitive(json, "lines");
     assert(cJSON_IsArray(lines));
 
     const cJSON *line = NULL;
     cJSON_ArrayForEach(line, lines) {
-        assert(cJSON_IsNumber(line));
-        PushLine(self, vm, line->valueint);
+        assert(cJSON_IsArray(line) && cJSON_GetArraySize(line) == 2);
+        const cJSON *offset = cJSON_GetArrayItem(line, 0);
+        const cJSON *number = cJSON_GetArrayItem(line, 1);
+        assert(cJSON_IsNumber(offset) && cJSON_IsNumber(number));
+        PushLine(self, vm, (ChunkLine) {.offset = offset->valueint, .line = number->valueint});
+    }
+}
+
+void ChunkFromBytecode(Chunk *self, VirtualMachine *vm, ObjectModule *module, BytecodeReader *reader) {
+    const uint32_t code_length = BytecodeReadU32(reader);
+    const uint32_t lines_length = BytecodeReadU32(reader);
+    const uint32_t constants_count = BytecodeReadU32(reader);
+    const uint32_t locals_count = BytecodeReadU32(reader);
+    const uint32_t stack_size = BytecodeReadU32(reader);
+
+    // TODO: Endianness. Lines are used in place, so this expects a little-endian host.
+    const uint8_t *code = BytecodeReadBytes(reader, code_length);
+    BytecodeReadAlign(reader, sizeof(uint32_t));
+    const uint8_t *lines = BytecodeReadBytes(reader, (size_t) lines_length * sizeof(ChunkLine));
+
+    // Every constant takes at least one byte, this also guards the allocation below.
+    if (reader->failed || constants_count > (size_t) (reader->end - reader->ptr)) {
+        reader->failed = true;
+        return;
+    }
+
+    self->mapped = true;
+    self->code = (uint8_t *) code;
+    self->code_length = code_length;
+    self->lines = (ChunkLine *) lines;
+    self->lines_length = lines_length;
+    self->locals_count = locals_count;
+    self->stack_size = stack_size;
+
+    self->constants = ALLOC_ARRAY(vm, Value, constants_count);
+    self->constants_capacity = constants_count;
+
+    for (uint32_t i = 0; i < constants_count && !reader->failed; ++i) {
+        self->constants[self->constants_length++] = ValueFromBytecode(vm, module, reader);
     }
 }
 
@@ -82,31 +142,35 @@ static void PushConstant(Chunk *self, VirtualMachine *vm, Value value) {
     self->constants[self->constants_length++] = value;
 }
 
-static void PushLine(Chunk *self, VirtualMachine *vm, size_t byte) {
+static void PushLine(Chunk *self, VirtualMachine *vm, ChunkLine line) {
     if (self->lines_length + 1 > self->lines_capacity) {
         const size_t new_capacity = GROW_CAPACITY(self->lines_capacity);
-        self->lines = REALLOC_ARRAY(vm, self->lines, size_t, new_capacity, self->lines_capacity);
+        self->lines = REALLOC_ARRAY(vm, self->lines, ChunkLine, new_capacity, self->lines_capacity);
         self->lines_capacity = new_capacity;
     }
 
-    self->lines[self->lines_length++] = byte;
+    self->lines[self->lines_length++] = line;
 }
 
 size_t ChunkGetLine(const Chunk *self, size_t offset) {
-    size_t counter = 0;
+    if (self->lines_length == 0) {
+        return 0;
+    }
 
-    for (int i = 0; i < self->lines_length; ++i) {
-        for (int j = self->lines[i]; j >= 0; --j) {
-            ++counter;
+    // The last entry that starts at or before the offset.
+    size_t low = 0;
+    size_t high = self->lines_length;
+    while (high - low > 1) {
+        const size_t middle = low + (high - low) / 2;
 
-            if (counter == offset) {
-                return i;
-            }
+        if (self->lines[middle].offset <= offset) {
+            low = middle;
+        } else {
+            high = middle;
         }
     }
 
-    assert(self->lines_length != 0);
-    return self->lines_length - 1;
+    return self->lines[low].line;
 }
 
 void ChunkDisassemble(const Chunk *self, FILE *out, const char *name) {
@@ -129,6 +193,16 @@ const uint8_t *DisassembleLoop(const Chunk *self, FILE *out, const uint8_t *offs
 
 const uint8_t *DisassembleClosure(const Chunk *self, FILE *out, const uint8_t *offset, const char *name);
 
+const uint8_t *DisassembleInvoke(const Chunk *self, FILE *out, const uint8_t *offset, const char *name);
+
+const uint8_t *DisassembleLocalLocal(const Chunk *self, FILE *out, const uint8_t *offset, const char *name);
+
+const uint8_t *DisassembleLocalConstant(const Chunk *self, FILE *out, const uint8_t *offset, const char *name);
+
+const uint8_t *DisassembleJumpLocalConstant(const Chunk *self, FILE *out, const uint8_t *offset, const char *name);
+
+const uint8_t *DisassembleWide(const Chunk *self, FILE *out, const uint8_t *offset, const char *name);
+
 const uint8_t *DisassembleUnknown(const Chunk *self, FILE *out, const uint8_t *offset, uint8_t byte);
 
 const uint8_t *ChunkDisassembleInstruction(const Chunk *self, FILE *out, const uint8_t *offset) {
@@ -136,8 +210,7 @@ const uint8_t *ChunkDisassembleInstruction(const Chunk *self, FILE *out, const u
 
     fprintf(out, "%04ld ", offset_num);
 
-    if (offset_num != 0 && ChunkGetLine(self, offset_num - 1) == ChunkGetLine(self, offset_num)) // Bad algorithm.
-    {
+    if (offset_num != 0 && ChunkGetLine(self, offset_num - 1) == ChunkGetLine(self, offset_num)) {
         fprintf(out, "   | ");
     } else {
         fprintf(out, "%4ld ", ChunkGetLine(self, offset_num));
@@ -220,13 +293,143 @@ const uint8_t *DisassembleClosure(const Chunk *self, FILE *out, const uint8_t *o
     return offset + 1 + 1 + count * 2;
 }
 
+const uint8_t *DisassembleInvoke(const Chunk *self, FILE *out, const uint8_t *offset, const char *name) {
+    uint8_t index = offset[1];
+    Value value = self->constants[index];
+
+    fprintf(out, "%-16s %4d ", name, index);
+    ValuePrint(value, out);
+    fprintf(out, " (%d args)\n", offset[2]);
+
+    return offset + 3;
+}
+
+const uint8_t *DisassembleLocalLocal(const Chunk *self, FILE *out, const uint8_t *offset, const char *name) {
+    fprintf(out, "%-16s %4d %4d\n", name, offset[1], offset[2]);
+    return offset + 3;
+}
+
+const uint8_t *DisassembleLocalConstant(const Chunk *self, FILE *out, const uint8_t *offset, const char *name) {
+    uint8_t index = offset[2];
+    Value value = self->constants[index];
+
+    fprintf(out, "%-16s %4d %4d ", name, offset[1], index);
+    ValuePrint(value, out);
+    fprintf(out, "\n");
+
+    return offset + 3;
+}
+
+const uint8_t *DisassembleJumpLocalConstant(const Chunk *self, FILE *out, const uint8_t *offset, const char *name) {
+    unsigned jump = offset[2] << 8 | offset[1];
+    uint8_t index = offset[4];
+    Value value = self->constants[index];
+
+    // The offset is counted from the end of the instruction, after the local and the constant.
+    unsigned arg = (offset - self->code) + jump + 5;
+
+    fprintf(out, "%-16s %04d %4d %4d ", name, arg, offset[3], index);
+    ValuePrint(value, out);
+    fprintf(out, "\n");
+
+    return offset + 5;
+}
+
+const uint8_t *DisassembleWide(const Chunk *self, FILE *out, const uint8_t *offset, const char *name) {
+    const Opcode opcode = offset[1];
+    size_t size = 0;
+
+    switch (opcode) {
+#define WIDE_SIZE(op, width) case Opcode_##op: size = Opcode_WIDE_##width; break;
+
+        Opcode_WIDE_LIST(WIDE_SIZE)
+
+#undef WIDE_SIZE
+
+        default:
+            return DisassembleUnknown(self, out, offset + 1, offset[1]);
+    }
+
+    uint32_t operand = 0;
+    for (size_t i = 0; i < size; ++i) {
+        operand |= (uint32_t) offset[2 + i] << (8 * i);
+    }
+
+    const uint8_t *next = offset + 2 + size;
+
+    // Operands after the widened one keep their size.
+    switch (opcode) {
+        case Opcode_Invoke:
+            next += 1;
+            break;
+        case Opcode_LessLocalConstJumpIfFalse:
+            next += 2;
+            break;
+        default:
+            break;
+    }
+
+    fprintf(out, "%s %-11s ", name, OpcodeToString(opcode));
+
+    if (size == Opcode_WIDE_LONG) {
+        const size_t target = opcode == Opcode_Loop ? (next - self->code) - operand : (next - self->code) + operand;
+        fprintf(out, "%04zu\n", target);
+        return next;
+    }
+
+    fprintf(out, "%4u\n", operand);
+    return next;
+}
+
 const uint8_t *DisassembleUnknown(const Chunk *self, FILE *out, const uint8_t *offset, uint8_t byte) {
     fprintf(out, "Unknown: 0x%02x\n", byte);
     return offset + 1;
 }
 
+InlineCache *ChunkGetCache(Chunk *self, VirtualMachine *vm, size_t constant) {
+    assert(constant < self->constants_length);
+
+    if (self->caches == NULL) {
+        InlineCache **caches = ALLOC_ARRAY(vm, InlineCache *, self->constants_length);
+        for (size_t i = 0; i < self->constants_length; ++i) {
+            caches[i] = NULL;
+        }
+        self->caches = caches;
+    }
+
+    if (self->caches[constant] == NULL) {
+        InlineCache *cache = ALLOC_ARRAY(vm, InlineCache, 1);
+        InlineCacheInit(cache);
+        self->caches[constant] = cache;
+    }
+
+    return self->caches[constant];
+}
+
 void ChunkMarkTraverse(Chunk *self, MemoryManager *memory) {
     for (size_t i = 0; i < self->constants_length; ++i) {
         ValueMark(self->constants[i], memory);
     }
+
+    if (self->caches != NULL) {
+        for (size_t i = 0; i < self->constants_length; ++i) {
+            if (self->caches[i] != NULL) {
+                InlineCacheMark(self->caches[i], memory);
+            }
+        }
+    }
+}
+
+void ChunkRelocateTraverse(Chunk *self, MemoryManager *memory) {
+    for (size_t i = 0; i < self->constants_length; ++i) {
+        ValueRelocate(&self->constants[i], memory);
+    }
+
+    if (self->caches != NULL) {
+        for (size_t i = 0; i < self->constants_length; ++i) {
+            if (self->caches[i] != NULL) {
+                InlineCacheRelocate(self->caches[i], memory);
+            }
+        }
+    }
 }
@@ -3,6 +3,15 @@
 
 #include "Common.h"
 
+#include "Bytecode.h"
+#include "InlineCache.h"
+
+/// The bytes from offset up to the offset of the next entry come from the line.
+typedef struct ChunkLine {
+    uint32_t offset;
+    uint32_t line;
+} ChunkLine;
+
 typedef struct Chunk {
     uint8_t *code;
     size_t code_length;
@@ -10,9 +19,13 @@ typedef struct Chunk {
     Value *constants;
     size_t constants_length;
     size_t constants_capacity;
-    size_t *lines;
+    ChunkLine *lines; // Sorted by offset, one entry per run of bytes on the same line.
     size_t lines_length;
     size_t lines_capacity;
+    size_t locals_count; // Stack slots used by the locals, the callee and the arguments included.
+    size_t stack_size; // Stack slots the frame takes at most, the temporaries of expressions included.
+    bool mapped; // Code and lines point into the mapped module file and are not freed.
+    InlineCache **caches; // Attribute caches by name constant, allocated on the first miss.
 } Chunk;
 
 void ChunkInit(Chunk *self);
@@ -21,6 +34,16 @@ void ChunkDeinit(Chunk *self, VirtualMachine *vm);
 
 void ChunkFromJSON(Chunk *self, VirtualMachine *vm, ObjectModule *module, const cJSON *json);
 
+void ChunkFromBytecode(Chunk *self, VirtualMachine *vm, ObjectModule *module, BytecodeReader *reader);
+
+/// NULL if the attribute at the constant was not accessed yet.
+static inline InlineCache *ChunkFindCache(const Chunk *self, size_t constant) {
+    return self->caches == NULL ? NULL : self->caches[constant];
+}
+
+InlineCache *ChunkGetCache(Chunk *self, VirtualMachine *vm, size_t constant);
+
+/// 0 if the chunk has no line information.
 size_t ChunkGetLine(const Chunk *self, size_t offset);
 
 void ChunkDisassemble(const Chunk *self, FILE *out, const char *name);
@@ -29,4 +52,6 @@ const uint8_t *ChunkDisassembleInstruction(const Chunk *self, FILE *out, const u
 
 void ChunkMarkTraverse(Chunk *self, MemoryManager *memory);
 
+void ChunkRelocateTraverse(Chunk *self, MemoryManager *memory);
+
 #endif // LOOP_CHUNK_H
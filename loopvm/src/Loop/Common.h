@@ -15,20 +15,102 @@
 #include "cJSON/cJSON.h"
 #include "cwalk/cwalk.h"
 
+// The value stack, the frames and the catch handlers start small and are doubled on demand.
+// A call keeps the callee's stack size, which loopc finds for every chunk, and VM_STACK_SIZE_PER_FRAME
+// more slots free above the stack top for the values the VM pushes itself.
 #define VM_STACK_SIZE_PER_FRAME 256
-#define VM_FRAMES_COUNT 64
-#define VM_HANDLERS_COUNT VM_FRAMES_COUNT
+#define VM_STACK_MAX_SIZE (4 * 1024 * 1024)
+#define VM_FRAMES_INITIAL_COUNT 4
+#define VM_FRAMES_MAX_COUNT (64 * 1024)
+#define VM_HANDLERS_INITIAL_COUNT 4
+#define VM_HANDLERS_MAX_COUNT VM_FRAMES_MAX_COUNT
 // #define VM_TRACE_EXECUTION
 
+// Opcode pairs listed by the text report of loopvm --profile-opcodes.
+#define OPCODE_PROFILE_TEXT_PAIRS 40
+
+// loopvm --profile-samples: CPU time between samples, the innermost frames kept per sample and
+// the frames all samples can take together.
+#define SAMPLER_INTERVAL_US 1000
+#define SAMPLER_MAX_DEPTH 256
+#define SAMPLER_BUFFER_FRAMES (1024 * 1024)
+
+// VM_COMPUTED_GOTO is set from CMake (LOOP_COMPUTED_GOTO). Labels as values are a GNU extension.
+#if defined(VM_COMPUTED_GOTO) && !defined(__GNUC__)
+#undef VM_COMPUTED_GOTO
+#endif
+
 // #define CHUNK_DISASM_AFTER_READING
 
 #define HASH_TABLE_MAX_LOAD_FACTOR 0.75
 
+// Fields of an instance that are stored in the object itself, the rest go to a separate array.
+#define INSTANCE_INLINE_FIELDS 4
+
+// Receivers remembered per attribute name in a chunk.
+#define INLINE_CACHE_ENTRIES 4
+
 #define LOOP_DEBUG_MODE
 
+// Defaults of loopvm --gc (see GCPolicy.h). GC_STRESS turns stress on, the collector then runs
+// on every growing allocation. The next major collection comes once the heap has grown to
+// GC_HEAP_GROW_FACTOR times the live bytes and at least GC_MIN_INTERVAL bytes were allocated.
 #define GC_STRESS
 //#define GC_LOG
 #define GC_HEAP_GROW_FACTOR 2
+#define GC_MIN_INTERVAL (1024 * 1024)
+
+// GC_GENERATIONAL is set from CMake (LOOP_GENERATIONAL_GC).
+// Bytes allocated after a collection before the young objects are collected again.
+#define GC_NURSERY_SIZE (256 * 1024)
+// With stress every collection is minor except each n-th one.
+#define GC_STRESS_MAJOR_INTERVAL 8
+
+// GC_INCREMENTAL is set from CMake (LOOP_INCREMENTAL_GC). A major collection marks in steps
+// taken every GC_MARK_STEP_SIZE allocated bytes, each runs until the marking is done or the
+// pause goal (loopvm --gc=pause=<microseconds>) is used up. The clock is read every GC_MARK_CLOCK_INTERVAL
+// objects.
+#define GC_PAUSE_BUDGET_MICROSECONDS 1000
+#define GC_MARK_STEP_SIZE (64 * 1024)
+#define GC_MARK_CLOCK_INTERVAL 64
+// With stress every growing allocation takes a step of this many objects.
+#define GC_STRESS_MARK_STEP 8
+
+// GC_PARALLEL is set from CMake (LOOP_PARALLEL_GC). Once a collection has traversed
+// GC_PARALLEL_MARK_THRESHOLD gray objects alone, one thread per CPU, at most GC_MAX_MARK_THREADS
+// (loopvm --gc=threads=<count>), traverses the rest. A thread steals at most GC_MARK_STEAL_BATCH
+// objects at once. With stress the threads mark every collection, GC_STRESS_MARK_THREADS of them
+// by default with GC_STRESS.
+#define GC_MAX_MARK_THREADS 8
+#define GC_MARK_STEAL_BATCH 64
+#define GC_PARALLEL_MARK_THRESHOLD 1024
+#define GC_STRESS_MARK_THREADS 4
+
+// GC_LAZY_SWEEP is set from CMake (LOOP_LAZY_SWEEP). A major collection leaves its dead objects
+// to steps that sweep GC_SWEEP_STEP_COUNT objects every GC_SWEEP_STEP_SIZE allocated bytes. What
+// is left is swept before the next major collection.
+#define GC_SWEEP_STEP_SIZE (16 * 1024)
+#define GC_SWEEP_STEP_COUNT 1024
+// With stress every growing allocation sweeps this many objects.
+#define GC_STRESS_SWEEP_STEP 8
+
+// MEMORY_SLAB_ALLOCATOR is set from CMake (LOOP_SLAB_ALLOCATOR). Objects of at most SLAB_MAX_CELL_SIZE
+// (128) bytes come from the slabs, that is all but functions. Marks stay in the object headers and
+// sweeping walks the object lists, minor collections only visit the young ones.
+
+// GC_COMPACTING is set from CMake (LOOP_COMPACTING_GC), it needs MEMORY_SLAB_ALLOCATOR. With
+// loopvm --gc=compact=1 a major collection that leaves more than GC_COMPACT_FREE_RATIO of the slabs
+// free, once they take GC_COMPACT_MIN_BYTES, has the objects moved out of the slabs that are at most
+// GC_COMPACT_OCCUPANCY full. Then those are released. With stress every major collection compacts
+// and every slab is emptied.
+#define GC_COMPACT_MIN_BYTES (1024 * 1024)
+#define GC_COMPACT_FREE_RATIO 0.5
+#define GC_COMPACT_OCCUPANCY 0.5
+
+// VM_JIT is set from CMake (LOOP_JIT). A function is compiled once calls, returns into it and
+// loop back edges in it have entered it this many times.
+#define JIT_THRESHOLD 1000
+//#define JIT_LOG
 
 // Forgive me.
 #define LOOP_PATH_MAX 4096
@@ -56,5 +138,7 @@ FORWARD_DECL(ObjectBoundMethod);
 FORWARD_DECL(ObjectClosure);
 FORWARD_DECL(ObjectUpvalue);
 FORWARD_DECL(ObjectList);
+FORWARD_DECL(ObjectShape);
+FORWARD_DECL(JitCode);
 
 #endif // LOOP_CONFIGURATION_H
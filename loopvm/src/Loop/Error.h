@@ -18,7 +18,9 @@
     o(FileNotFound) \
     o(OutOfRange) \
     o(CircularImport) \
-    o(UnhandledException)
+    o(UnhandledException) \
+    o(InvalidBytecode) \
+    o(IntegerOverflow)
 
 typedef enum Error {
 #define Error_ENUM(name) Error_##name,
@@ -89,7 +89,51 @@ ObjectString *RemoveExtension(VirtualMachine *vm, const ObjectString *path) {
 
 #ifdef LOOP_COMPILE_UNIX
 
+#include <fcntl.h>
 #include <linux/limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Error MapFile(FILE *err_out, const char *path, const uint8_t **data, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(err_out, "error: cannot open file '%s'\n", path);
+        return Error_FileNotFound;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        fprintf(err_out, "error: cannot read file '%s'\n", path);
+        close(fd);
+        return Error_IOError;
+    }
+
+    *data = NULL;
+    *size = info.st_size;
+
+    if (*size == 0) {
+        close(fd);
+        return Error_None;
+    }
+
+    void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        fprintf(err_out, "error: cannot map file '%s'\n", path);
+        return Error_IOError;
+    }
+
+    *data = map;
+    return Error_None;
+}
+
+void UnmapFile(const uint8_t *data, size_t size) {
+    if (data != NULL) {
+        munmap((void *) data, size);
+    }
+}
 
 ObjectString* GetAbsolutePath(VirtualMachine* vm, const ObjectString* path)
 {
@@ -106,6 +150,44 @@ ObjectString* GetAbsolutePath(VirtualMachine* vm, const ObjectString* path)
 
 #include <Windows.h>
 
+// No mapping there, the file is just read into memory.
+
+Error MapFile(FILE *err_out, const char *path, const uint8_t **data, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(err_out, "error: cannot open file '%s'\n", path);
+        return Error_FileNotFound;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+
+    *data = NULL;
+
+    if (*size == 0) {
+        fclose(file);
+        return Error_None;
+    }
+
+    uint8_t *buffer = malloc(*size);
+    if (buffer == NULL) {
+        fprintf(err_out, "FATAL ERROR: out of memory\n");
+        fclose(file);
+        return Error_OutOfMemory;
+    }
+
+    *size = fread(buffer, 1, *size, file);
+    fclose(file);
+    *data = buffer;
+
+    return Error_None;
+}
+
+void UnmapFile(const uint8_t *data, size_t size) {
+    free((void *) data);
+}
+
 ObjectString *GetAbsolutePath(VirtualMachine *vm, const ObjectString *path) {
     char buffer[MAX_PATH];
     if (GetFullPathName(path->str, MAX_PATH, buffer, NULL) == 0) {
@@ -16,6 +16,13 @@ ObjectString *GetBaseName(VirtualMachine *vm, const ObjectString *path);
 /// Uses 'malloc'. Free the returned buffer with 'free' if there is no error.
 Error ReadFileWithComments(FILE *err_out, const char *path, char **ptr);
 
+/// Maps the whole file read-only. Release it with UnmapFile if there is no error.
+/// An empty file gives NULL and size 0.
+Error MapFile(FILE *err_out, const char *path, const uint8_t **data, size_t *size);
+
+/// Accepts NULL.
+void UnmapFile(const uint8_t *data, size_t size);
+
 // TODO: TOCTOU vulnerability?
 bool DoesPathExists(const ObjectString *path);
 
@@ -0,0 +1,169 @@
+#include "GCPolicy.h"
+
+#include <ctype.h>
+
+// Longest key=value pair.
+#define SETTING_MAX_LENGTH 64
+
+void GCPolicyInit(GCPolicy *self) {
+    self->growth = GC_HEAP_GROW_FACTOR;
+    self->max_heap = 0;
+    self->min_interval = GC_MIN_INTERVAL;
+    self->pause_nanoseconds = (uint64_t) GC_PAUSE_BUDGET_MICROSECONDS * 1000;
+    self->threads = 0;
+#ifdef GC_STRESS
+    self->stress = true;
+    self->compact = true;
+#else
+    self->stress = false;
+    self->compact = false;
+#endif
+}
+
+static bool ParseUnsigned(const char *text, uint64_t *result, const char **end) {
+    if (!isdigit((unsigned char) *text)) {
+        return false;
+    }
+
+    char *rest = NULL;
+    *result = strtoull(text, &rest, 10);
+    *end = rest;
+    return true;
+}
+
+static bool ParseCount(const char *text, uint64_t *result) {
+    const char *end = NULL;
+    return ParseUnsigned(text, result, &end) && *end == '\0';
+}
+
+static bool ParseBytes(const char *text, size_t *result) {
+    const char *end = NULL;
+    uint64_t value = 0;
+    if (!ParseUnsigned(text, &value, &end)) {
+        return false;
+    }
+
+    int shift = 0;
+    switch (*end) {
+        case 'K':
+            shift = 10;
+            break;
+        case 'M':
+            shift = 20;
+            break;
+        case 'G':
+            shift = 30;
+            break;
+        case '\0':
+            break;
+        default:
+            return false;
+    }
+
+    if (shift != 0 && *++end != '\0') {
+        return false;
+    }
+
+    if (value > (SIZE_MAX >> shift)) {
+        return false;
+    }
+
+    *result = (size_t) value << shift;
+    return true;
+}
+
+static bool ParseSetting(GCPolicy *self, const char *key, const char *value) {
+    uint64_t count = 0;
+
+    if (strcmp(key, "growth") == 0) {
+        char *end = NULL;
+        const double growth = strtod(value, &end);
+        if (end == value || *end != '\0' || !(growth >= 1.0)) {
+            return false;
+        }
+
+        self->growth = growth;
+        return true;
+    }
+
+    if (strcmp(key, "max-heap") == 0) {
+        return ParseBytes(value, &self->max_heap);
+    }
+
+    if (strcmp(key, "min-interval") == 0) {
+        return ParseBytes(value, &self->min_interval);
+    }
+
+    if (strcmp(key, "pause") == 0) {
+        if (!ParseCount(value, &count) || count > UINT64_MAX / 1000) {
+            return false;
+        }
+
+        self->pause_nanoseconds = count * 1000;
+        return true;
+    }
+
+    if (strcmp(key, "threads") == 0) {
+        if (!ParseCount(value, &count) || count > GC_MAX_MARK_THREADS) {
+            return false;
+        }
+
+        self->threads = (size_t) count;
+        return true;
+    }
+
+    if (strcmp(key, "stress") == 0) {
+        if (!ParseCount(value, &count) || count > 1) {
+            return false;
+        }
+
+        self->stress = count == 1;
+        return true;
+    }
+
+    if (strcmp(key, "compact") == 0) {
+        if (!ParseCount(value, &count) || count > 1) {
+            return false;
+        }
+
+        self->compact = count == 1;
+        return true;
+    }
+
+    return false;
+}
+
+bool GCPolicyParse(GCPolicy *self, const char *settings) {
+    const char *setting = settings;
+
+    while (*setting != '\0') {
+        const char *end = strchr(setting, ',');
+        if (end == NULL) {
+            end = setting + strlen(setting);
+        }
+
+        const size_t length = (size_t) (end - setting);
+        bool valid = false;
+
+        if (length < SETTING_MAX_LENGTH) {
+            char buffer[SETTING_MAX_LENGTH];
+            memcpy(buffer, setting, length);
+            buffer[length] = '\0';
+
+            char *equals = strchr(buffer, '=');
+            if (equals != NULL) {
+                *equals = '\0';
+                valid = ParseSetting(self, buffer, equals + 1);
+            }
+        }
+
+        if (!valid) {
+            fprintf(USER_ERR, "error: bad GC setting '%.*s'\n", (int) length, setting);
+            return false;
+        }
+
+        setting = *end == ',' ? end + 1 : end;
+    }
+
+    return true;
+}
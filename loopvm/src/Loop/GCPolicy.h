@@ -0,0 +1,32 @@
+#ifndef LOOP_GCPOLICY_H
+#define LOOP_GCPOLICY_H
+
+#include "Common.h"
+
+/// When and how the collector runs, set with loopvm --gc=<settings> or the LOOP_GC environment
+/// variable. The settings are comma-separated, later ones win:
+///   growth=<ratio>        the next major collection comes once the heap is the live bytes times ratio
+///   max-heap=<bytes>      brings major collections forward to keep the heap below, 0 for no limit
+///   min-interval=<bytes>  allocated at least between two major collections
+///   pause=<microseconds>  pause goal of incremental marking, 0 marks in a single pause
+///   threads=<count>       marking threads with GC_PARALLEL, 0 for one per CPU
+///   stress=<0|1>          collects on every growing allocation
+///   compact=<0|1>         moves objects out of sparse slabs after major collections with GC_COMPACTING
+/// Byte counts take a K, M or G suffix.
+typedef struct GCPolicy {
+    double growth;
+    size_t max_heap;
+    size_t min_interval;
+    uint64_t pause_nanoseconds;
+    size_t threads;
+    bool stress;
+    bool compact;
+} GCPolicy;
+
+/// The defaults of Common.h, stress and compact are on with GC_STRESS.
+void GCPolicyInit(GCPolicy *self);
+
+/// Prints an error and returns false on the first malformed setting, the ones before it are applied.
+bool GCPolicyParse(GCPolicy *self, const char *settings);
+
+#endif // LOOP_GCPOLICY_H
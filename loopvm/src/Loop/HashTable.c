@@ -74,9 +74,10 @@ static void AdjustCapacity(HashTable *self, VirtualMachine *vm, size_t new_capac
     self->count = new_count;
 }
 
+// Capacity is always a power of two (see GROW_CAPACITY), so the index is masked instead of divided.
 static HashTableEntry *FindEntry(HashTableEntry *entries, size_t capacity, Value key) {
     size_t hash = ValueHash(key);
-    size_t index = hash % capacity;
+    size_t index = hash & (capacity - 1);
     HashTableEntry *thombstone = NULL;
 
     while (true) {
@@ -94,7 +95,7 @@ static HashTableEntry *FindEntry(HashTableEntry *entries, size_t capacity, Value
             thombstone = entry;
         }
 
-        index = (index + 1) % capacity;
+        index = (index + 1) & (capacity - 1);
     }
 }
 
@@ -123,27 +124,34 @@ bool HashTableGet(HashTable *self, Value key, Value *value) {
 }
 
 bool HashTableGetStringKey(HashTable *self, const char *key_str, size_t length, size_t hash, ObjectString **ptr) {
-    // TODO: This is bad. Because it is not like hash table lookup. Also for strings interning no need for these checks.
+    // Walks the same probe sequence as FindEntry, but compares contents instead of identity,
+    // so interning does not need the string object to exist.
 
-    for (size_t i = 0; i < self->capacity; ++i) {
-        HashTableEntry *entry = &self->entries[i];
-        Value key = entry->key;
+    if (self->count == 0) {
+        return false;
+    }
 
-        if (ValueIsObject(key)) {
-            Object *obj = ValueAsObject(key);
+    size_t index = hash & (self->capacity - 1);
 
-            if (ObjectIsString(obj)) {
-                ObjectString *str = ObjectAsString(obj);
+    while (true) {
+        HashTableEntry *entry = &self->entries[index];
+        Value key = entry->key;
 
-                if (str->hash == hash && str->length == length && memcmp(str->str, key_str, length) == 0) {
-                    *ptr = str;
-                    return true;
-                }
+        if (ValueIsNull(key)) {
+            if (ValueIsNull(entry->value)) {
+                return false;
+            }
+        } else if (ValueIsObject(key) && ObjectIsString(ValueAsObject(key))) {
+            ObjectString *str = ObjectAsString(ValueAsObject(key));
+
+            if (str->hash == hash && str->length == length && memcmp(str->str, key_str, length) == 0) {
+                *ptr = str;
+                return true;
             }
         }
-    }
 
-    return false;
+        index = (index + 1) & (self->capacity - 1);
+    }
 }
 
 bool HashTableDelete(HashTable *self, Value key) {
@@ -199,6 +207,14 @@ void HashTableMark(HashTable *self, MemoryManager *memory) {
     }
 }
 
+void HashTableRelocate(HashTable *self, MemoryManager *memory) {
+    for (size_t i = 0; i < self->capacity; ++i) {
+        HashTableEntry *entry = &self->entries[i];
+        ValueRelocate(&entry->key, memory);
+        ValueRelocate(&entry->value, memory);
+    }
+}
+
 void HashTableRemoveWhite(HashTable *self, MemoryManager *memory) {
     for (size_t i = 0; i < self->capacity; ++i) {
         HashTableEntry *entry = &self->entries[i];
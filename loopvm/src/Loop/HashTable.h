@@ -37,4 +37,7 @@ void HashTableMark(HashTable *self, MemoryManager *memory);
 
 void HashTableRemoveWhite(HashTable *self, MemoryManager *memory);
 
+/// Keys keep their place, only strings are hashed and by their contents.
+void HashTableRelocate(HashTable *self, MemoryManager *memory);
+
 #endif // LOOP_HASHTABLE_H
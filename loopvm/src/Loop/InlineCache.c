@@ -0,0 +1,41 @@
+#include "InlineCache.h"
+
+#include "Object.h"
+
+void InlineCacheInit(InlineCache *self) {
+    for (size_t i = 0; i < INLINE_CACHE_ENTRIES; ++i) {
+        self->entries[i].kind = InlineCacheKind_Field;
+        self->entries[i].shape = NULL;
+        self->entries[i].klass = NULL;
+        self->entries[i].method = NULL;
+        self->entries[i].new_shape = NULL;
+        self->entries[i].index = 0;
+    }
+
+    self->next = 0;
+}
+
+void InlineCacheAdd(InlineCache *self, InlineCacheEntry entry) {
+    self->entries[self->next] = entry;
+    self->next = (self->next + 1) % INLINE_CACHE_ENTRIES;
+}
+
+void InlineCacheMark(InlineCache *self, MemoryManager *memory) {
+    for (size_t i = 0; i < INLINE_CACHE_ENTRIES; ++i) {
+        InlineCacheEntry *entry = &self->entries[i];
+        ObjectMarkMaybeNull((Object *) entry->shape, memory);
+        ObjectMarkMaybeNull((Object *) entry->klass, memory);
+        ObjectMarkMaybeNull((Object *) entry->method, memory);
+        ObjectMarkMaybeNull((Object *) entry->new_shape, memory);
+    }
+}
+
+void InlineCacheRelocate(InlineCache *self, MemoryManager *memory) {
+    for (size_t i = 0; i < INLINE_CACHE_ENTRIES; ++i) {
+        InlineCacheEntry *entry = &self->entries[i];
+        entry->shape = (ObjectShape *) ObjectRelocateMaybeNull((Object *) entry->shape, memory);
+        entry->klass = (ObjectClass *) ObjectRelocateMaybeNull((Object *) entry->klass, memory);
+        entry->method = (ObjectFunction *) ObjectRelocateMaybeNull((Object *) entry->method, memory);
+        entry->new_shape = (ObjectShape *) ObjectRelocateMaybeNull((Object *) entry->new_shape, memory);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef LOOP_INLINECACHE_H
+#define LOOP_INLINECACHE_H
+
+#include "Common.h"
+
+typedef enum InlineCacheKind {
+    InlineCacheKind_Field, // Field at index.
+    InlineCacheKind_Method, // Method of klass, the field is absent in shape.
+    InlineCacheKind_Transition, // Storing a new field at index changes shape to new_shape.
+} InlineCacheKind;
+
+typedef struct InlineCacheEntry {
+    InlineCacheKind kind;
+    ObjectShape *shape; // Receiver shape, NULL if the entry is empty.
+    ObjectClass *klass;
+    ObjectFunction *method;
+    ObjectShape *new_shape;
+    size_t index;
+} InlineCacheEntry;
+
+/// Receivers seen by attribute accesses of one name in one chunk.
+/// Entries are replaced in a round-robin order once all are taken.
+typedef struct InlineCache {
+    InlineCacheEntry entries[INLINE_CACHE_ENTRIES];
+    size_t next;
+} InlineCache;
+
+void InlineCacheInit(InlineCache *self);
+
+void InlineCacheAdd(InlineCache *self, InlineCacheEntry entry);
+
+/// Field or method entry for reading. self may be NULL.
+static inline const InlineCacheEntry *InlineCacheFindGet(const InlineCache *self,
+                                                         const ObjectShape *shape, const ObjectClass *klass) {
+    if (self == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < INLINE_CACHE_ENTRIES; ++i) {
+        const InlineCacheEntry *entry = &self->entries[i];
+        if (entry->shape == shape &&
+            (entry->kind == InlineCacheKind_Field ||
+             (entry->kind == InlineCacheKind_Method && entry->klass == klass))) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/// Field or transition entry for writing. self may be NULL.
+static inline const InlineCacheEntry *InlineCacheFindSet(const InlineCache *self, const ObjectShape *shape) {
+    if (self == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < INLINE_CACHE_ENTRIES; ++i) {
+        const InlineCacheEntry *entry = &self->entries[i];
+        if (entry->shape == shape &&
+            (entry->kind == InlineCacheKind_Field || entry->kind == InlineCacheKind_Transition)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+void InlineCacheMark(InlineCache *self, MemoryManager *memory);
+
+void InlineCacheRelocate(InlineCache *self, MemoryManager *memory);
+
+#endif // LOOP_INLINECACHE_H
@@ -0,0 +1,870 @@
+#include "Jit.h"
+
+#ifdef JIT_SUPPORTED
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Opcode.h"
+
+#include "Objects/Function.h"
+#include "Objects/Module.h"
+#include "Objects/String.h"
+
+typedef enum Register {
+    Register_Rax,
+    Register_Rcx,
+    Register_Rdx,
+    Register_Rbx,
+    Register_Rsp,
+    Register_Rbp,
+    Register_Rsi,
+    Register_Rdi,
+    Register_R8,
+    Register_R9,
+    Register_R10,
+    Register_R11,
+    Register_R12,
+    Register_R13,
+    Register_R14,
+    Register_R15,
+} Register;
+
+// The generated code keeps its state in callee-saved registers, rax, rcx and rdx are scratch.
+#define REGISTER_SP Register_Rbx
+#define REGISTER_LOCALS Register_R12
+#define REGISTER_CONSTANTS Register_R13
+#define REGISTER_FRAME Register_R14
+#define REGISTER_CONTEXT Register_R15
+
+// The /digit of the 0x83 form, the register form of each operation is (digit << 3) | 1.
+typedef enum AluOp {
+    AluOp_Add = 0,
+    AluOp_Or = 1,
+    AluOp_And = 4,
+    AluOp_Sub = 5,
+    AluOp_Cmp = 7,
+} AluOp;
+
+typedef enum Condition {
+    Condition_Overflow = 0x0,
+    Condition_Equal = 0x4,
+    Condition_NotEqual = 0x5,
+    Condition_Less = 0xC,
+    Condition_GreaterEqual = 0xD,
+    Condition_LessEqual = 0xE,
+    Condition_Greater = 0xF,
+    Condition_Always = -1,
+} Condition;
+
+/// Passed to the generated code by JitRun, the stack pointer comes back in it.
+typedef struct JitContext {
+    Value *sp;
+    Value *locals;
+    const Value *constants;
+    CallFrame *frame;
+    VirtualMachine *vm;
+} JitContext;
+
+/// Returns the bytecode offset to continue at.
+typedef uint32_t (*JitFunction)(JitContext *context, const uint8_t *entry);
+
+/// A rel32 that is patched once the code of the target is known.
+typedef struct Fixup {
+    uint32_t position;
+    uint32_t target; // Bytecode offset.
+} Fixup;
+
+typedef struct FixupArray {
+    Fixup *fixups;
+    size_t length;
+    size_t capacity;
+} FixupArray;
+
+typedef struct Assembler {
+    uint8_t *code;
+    size_t length;
+    size_t capacity;
+    size_t epilogue;
+    FixupArray jumps; // To the code of bytecode offsets.
+    FixupArray exits; // To an exit stub for bytecode offsets.
+    bool failed; // Out of memory.
+} Assembler;
+
+static void AssemblerInit(Assembler *self) {
+    self->code = NULL;
+    self->length = 0;
+    self->capacity = 0;
+    self->epilogue = 0;
+    self->jumps = (FixupArray) {NULL, 0, 0};
+    self->exits = (FixupArray) {NULL, 0, 0};
+    self->failed = false;
+}
+
+static void AssemblerDeinit(Assembler *self) {
+    free(self->code);
+    free(self->jumps.fixups);
+    free(self->exits.fixups);
+    AssemblerInit(self);
+}
+
+static void AddFixup(Assembler *self, FixupArray *array, uint32_t position, uint32_t target) {
+    if (array->length + 1 > array->capacity) {
+        const size_t capacity = GROW_CAPACITY(array->capacity);
+        Fixup *fixups = realloc(array->fixups, sizeof(Fixup) * capacity);
+        if (fixups == NULL) {
+            self->failed = true;
+            return;
+        }
+
+        array->fixups = fixups;
+        array->capacity = capacity;
+    }
+
+    array->fixups[array->length++] = (Fixup) {position, target};
+}
+
+static void EmitByte(Assembler *self, uint8_t byte) {
+    if (self->length + 1 > self->capacity) {
+        const size_t capacity = self->capacity < 256 ? 256 : self->capacity * 2;
+        uint8_t *code = realloc(self->code, capacity);
+        if (code == NULL) {
+            self->failed = true;
+            return;
+        }
+
+        self->code = code;
+        self->capacity = capacity;
+    }
+
+    self->code[self->length++] = byte;
+}
+
+static void EmitU32(Assembler *self, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        EmitByte(self, (uint8_t) (value >> (8 * i)));
+    }
+}
+
+static void EmitU64(Assembler *self, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        EmitByte(self, (uint8_t) (value >> (8 * i)));
+    }
+}
+
+static void PatchU32(Assembler *self, size_t position, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        self->code[position + i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+static void EmitRex(Assembler *self, bool wide, uint8_t reg, Register rm) {
+    const uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+    if (rex != 0x40) {
+        EmitByte(self, rex);
+    }
+}
+
+static void EmitModRMRegister(Assembler *self, uint8_t reg, Register rm) {
+    EmitByte(self, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void EmitModRMMemory(Assembler *self, uint8_t reg, Register base, int32_t displacement) {
+    const bool short_displacement = displacement >= INT8_MIN && displacement <= INT8_MAX;
+
+    EmitByte(self, (short_displacement ? 0x40 : 0x80) | ((reg & 7) << 3) | (base & 7));
+
+    // rsp and r12 as the base need a SIB byte.
+    if ((base & 7) == Register_Rsp) {
+        EmitByte(self, 0x24);
+    }
+
+    if (short_displacement) {
+        EmitByte(self, (uint8_t) displacement);
+    } else {
+        EmitU32(self, (uint32_t) displacement);
+    }
+}
+
+// mov reg, [base + displacement]
+static void EmitLoad(Assembler *self, Register reg, Register base, int32_t displacement) {
+    EmitRex(self, true, reg, base);
+    EmitByte(self, 0x8B);
+    EmitModRMMemory(self, reg, base, displacement);
+}
+
+// mov [base + displacement], reg
+static void EmitStore(Assembler *self, Register base, int32_t displacement, Register reg) {
+    EmitRex(self, true, reg, base);
+    EmitByte(self, 0x89);
+    EmitModRMMemory(self, reg, base, displacement);
+}
+
+// mov dst, src
+static void EmitMove(Assembler *self, bool wide, Register dst, Register src) {
+    EmitRex(self, wide, src, dst);
+    EmitByte(self, 0x89);
+    EmitModRMRegister(self, src, dst);
+}
+
+// mov reg32, immediate, zero-extended to the whole register.
+static void EmitMoveImmediate(Assembler *self, Register reg, uint32_t immediate) {
+    EmitRex(self, false, 0, reg);
+    EmitByte(self, 0xB8 + (reg & 7));
+    EmitU32(self, immediate);
+}
+
+// mov reg, immediate64
+static void EmitMoveImmediate64(Assembler *self, Register reg, uint64_t immediate) {
+    EmitRex(self, true, 0, reg);
+    EmitByte(self, 0xB8 + (reg & 7));
+    EmitU64(self, immediate);
+}
+
+// op dst, src
+static void EmitAlu(Assembler *self, AluOp op, bool wide, Register dst, Register src) {
+    EmitRex(self, wide, src, dst);
+    EmitByte(self, (op << 3) | 1);
+    EmitModRMRegister(self, src, dst);
+}
+
+// op reg, immediate8
+static void EmitAluImmediate(Assembler *self, AluOp op, bool wide, Register reg, int8_t immediate) {
+    EmitRex(self, wide, 0, reg);
+    EmitByte(self, 0x83);
+    EmitModRMRegister(self, op, reg);
+    EmitByte(self, (uint8_t) immediate);
+}
+
+// sar reg, count
+static void EmitShiftRight(Assembler *self, Register reg, uint8_t count) {
+    EmitRex(self, true, 0, reg);
+    EmitByte(self, 0xC1);
+    EmitModRMRegister(self, 7, reg);
+    EmitByte(self, count);
+}
+
+// imul dst, src
+static void EmitMultiply(Assembler *self, Register dst, Register src) {
+    EmitRex(self, true, dst, src);
+    EmitByte(self, 0x0F);
+    EmitByte(self, 0xAF);
+    EmitModRMRegister(self, dst, src);
+}
+
+// neg reg
+static void EmitNegate(Assembler *self, Register reg) {
+    EmitRex(self, true, 0, reg);
+    EmitByte(self, 0xF7);
+    EmitModRMRegister(self, 3, reg);
+}
+
+static void EmitPush(Assembler *self, Register reg) {
+    EmitStore(self, REGISTER_SP, 0, reg);
+    EmitAluImmediate(self, AluOp_Add, true, REGISTER_SP, sizeof(Value));
+}
+
+static void EmitDrop(Assembler *self, int8_t count) {
+    EmitAluImmediate(self, AluOp_Sub, true, REGISTER_SP, (int8_t) (count * sizeof(Value)));
+}
+
+static void EmitPushRegister(Assembler *self, Register reg) {
+    EmitRex(self, false, 0, reg);
+    EmitByte(self, 0x50 + (reg & 7));
+}
+
+static void EmitPopRegister(Assembler *self, Register reg) {
+    EmitRex(self, false, 0, reg);
+    EmitByte(self, 0x58 + (reg & 7));
+}
+
+// jmp or jcc with a rel32 that is patched later, returns the position of the rel32.
+static uint32_t EmitBranch(Assembler *self, Condition condition) {
+    if (condition == Condition_Always) {
+        EmitByte(self, 0xE9);
+    } else {
+        EmitByte(self, 0x0F);
+        EmitByte(self, 0x80 + condition);
+    }
+
+    const uint32_t position = self->length;
+    EmitU32(self, 0);
+    return position;
+}
+
+static void EmitJump(Assembler *self, Condition condition, uint32_t target) {
+    const uint32_t position = EmitBranch(self, condition);
+    AddFixup(self, &self->jumps, position, target);
+}
+
+static void EmitCall(Assembler *self, const void *function) {
+    EmitMoveImmediate64(self, Register_Rax, (uint64_t) (uintptr_t) function);
+    // call rax
+    EmitByte(self, 0xFF);
+    EmitByte(self, 0xD0);
+}
+
+/// Returns the offset of the instruction to the interpreter.
+static void EmitExit(Assembler *self, uint32_t instruction) {
+    EmitMoveImmediate(self, Register_Rax, instruction);
+    EmitByte(self, 0xE9);
+    EmitU32(self, (uint32_t) (self->epilogue - (self->length + 4)));
+}
+
+static void EmitExitIf(Assembler *self, Condition condition, uint32_t instruction) {
+    const uint32_t position = EmitBranch(self, condition);
+    AddFixup(self, &self->exits, position, instruction);
+}
+
+/// Leaves for the interpreter at the instruction unless reg holds an int. The guards of an
+/// instruction come before anything it changes, the interpreter then runs it from the start.
+static void EmitIntGuard(Assembler *self, Register reg, uint32_t instruction) {
+    EmitMove(self, false, Register_Rdx, reg);
+    EmitAluImmediate(self, AluOp_And, false, Register_Rdx, VALUE_TAG_MASK);
+    EmitAluImmediate(self, AluOp_Cmp, false, Register_Rdx, VALUE_TAG_INT);
+    EmitExitIf(self, Condition_NotEqual, instruction);
+}
+
+// movsxd rax, eax then lea rax, [rax * 4 + tag]
+static void EmitTag(Assembler *self, uint8_t tag) {
+    EmitByte(self, 0x48);
+    EmitByte(self, 0x63);
+    EmitModRMRegister(self, Register_Rax, Register_Rax);
+
+    EmitByte(self, 0x48);
+    EmitByte(self, 0x8D);
+    EmitByte(self, 0x04);
+    EmitByte(self, 0x85);
+    EmitU32(self, tag);
+}
+
+// setcc al, movzx eax, al and the bool in rax.
+static void EmitBoolFromCondition(Assembler *self, Condition condition) {
+    EmitByte(self, 0x0F);
+    EmitByte(self, 0x90 + condition);
+    EmitByte(self, 0xC0);
+
+    EmitByte(self, 0x0F);
+    EmitByte(self, 0xB6);
+    EmitByte(self, 0xC0);
+
+    EmitTag(self, VALUE_TAG_BOOL);
+}
+
+// null and false are the only false values and differ only in the lowest bit.
+_Static_assert((VALUE_TAG_BOOL | 1) == VALUE_TAG_NULL, "false and null must differ in the lowest bit");
+
+// Sets the flags to equal if reg is false, clobbers reg.
+static void EmitFalseTest(Assembler *self, Register reg) {
+    EmitAluImmediate(self, AluOp_Or, true, reg, 1);
+    EmitAluImmediate(self, AluOp_Cmp, true, reg, VALUE_TAG_NULL);
+}
+
+static void EmitLocalsOperands(Assembler *self, uint8_t a, uint8_t b, uint32_t instruction) {
+    EmitLoad(self, Register_Rax, REGISTER_LOCALS, a * (int32_t) sizeof(Value));
+    EmitLoad(self, Register_Rcx, REGISTER_LOCALS, b * (int32_t) sizeof(Value));
+    EmitIntGuard(self, Register_Rax, instruction);
+    EmitIntGuard(self, Register_Rcx, instruction);
+}
+
+static void EmitLocalConstantOperands(Assembler *self, uint8_t local, uint8_t constant, uint32_t instruction) {
+    EmitLoad(self, Register_Rax, REGISTER_LOCALS, local * (int32_t) sizeof(Value));
+    EmitLoad(self, Register_Rcx, REGISTER_CONSTANTS, constant * (int32_t) sizeof(Value));
+    EmitIntGuard(self, Register_Rax, instruction);
+    EmitIntGuard(self, Register_Rcx, instruction);
+}
+
+// The two operands on top of the stack, still on it.
+static void EmitStackOperands(Assembler *self, uint32_t instruction) {
+    EmitLoad(self, Register_Rax, REGISTER_SP, -2 * (int32_t) sizeof(Value));
+    EmitLoad(self, Register_Rcx, REGISTER_SP, -1 * (int32_t) sizeof(Value));
+    EmitIntGuard(self, Register_Rax, instruction);
+    EmitIntGuard(self, Register_Rcx, instruction);
+}
+
+// Works on the tagged ints like ValueIntAdd and friends: with the tag taken off one operand
+// the 64-bit operation overflows exactly when the int does, and the interpreter then reports it.
+static void EmitIntArithmetic(Assembler *self, Opcode opcode, uint32_t instruction) {
+    switch (opcode) {
+        case Opcode_Add:
+            EmitAluImmediate(self, AluOp_Sub, true, Register_Rcx, VALUE_TAG_INT);
+            EmitAlu(self, AluOp_Add, true, Register_Rax, Register_Rcx);
+            break;
+        case Opcode_Subtract:
+            EmitAluImmediate(self, AluOp_Sub, true, Register_Rcx, VALUE_TAG_INT);
+            EmitAlu(self, AluOp_Sub, true, Register_Rax, Register_Rcx);
+            break;
+        case Opcode_Multiply:
+            EmitAluImmediate(self, AluOp_Sub, true, Register_Rax, VALUE_TAG_INT);
+            EmitShiftRight(self, Register_Rcx, VALUE_PAYLOAD_SHIFT);
+            EmitMultiply(self, Register_Rax, Register_Rcx);
+            break;
+        default:
+            assert(false);
+    }
+
+    EmitExitIf(self, Condition_Overflow, instruction);
+
+    if (opcode == Opcode_Multiply) {
+        EmitAluImmediate(self, AluOp_Or, true, Register_Rax, VALUE_TAG_INT);
+    }
+}
+
+static void EmitBinaryArithmetic(Assembler *self, Opcode opcode, uint32_t instruction) {
+    EmitStackOperands(self, instruction);
+    EmitIntArithmetic(self, opcode, instruction);
+    EmitDrop(self, 1);
+    EmitStore(self, REGISTER_SP, -1 * (int32_t) sizeof(Value), Register_Rax);
+}
+
+// Tagged ints of the same sign compare like the ints.
+static void EmitComparison(Assembler *self, Condition condition, uint32_t instruction, bool guard) {
+    if (guard) {
+        EmitStackOperands(self, instruction);
+    } else {
+        EmitLoad(self, Register_Rax, REGISTER_SP, -2 * (int32_t) sizeof(Value));
+        EmitLoad(self, Register_Rcx, REGISTER_SP, -1 * (int32_t) sizeof(Value));
+    }
+
+    EmitAlu(self, AluOp_Cmp, true, Register_Rax, Register_Rcx);
+    EmitBoolFromCondition(self, condition);
+    EmitDrop(self, 1);
+    EmitStore(self, REGISTER_SP, -1 * (int32_t) sizeof(Value), Register_Rax);
+}
+
+static void JitPrint(Value value) {
+    ValuePrint(value, USER_OUT);
+    fprintf(USER_OUT, "\n");
+}
+
+static void JitSetGlobal(CallFrame *frame, VirtualMachine *vm, uint32_t index, Value value) {
+    ObjectModule *module = frame->function->module;
+    assert(index < module->globals_count);
+    module->globals[index] = value;
+    MemoryManagerWriteBarrier(&vm->memory_manager, (Object *) module);
+}
+
+static void EmitSetGlobal(Assembler *self, uint8_t index) {
+    EmitMove(self, true, Register_Rdi, REGISTER_FRAME);
+    EmitLoad(self, Register_Rsi, REGISTER_CONTEXT, offsetof(JitContext, vm));
+    EmitMoveImmediate(self, Register_Rdx, index);
+    EmitLoad(self, Register_Rcx, REGISTER_SP, -1 * (int32_t) sizeof(Value));
+    EmitCall(self, (const void *) JitSetGlobal);
+}
+
+// Five pushes after the return address keep the stack aligned for the helper calls.
+static void EmitPrologue(Assembler *self) {
+    EmitPushRegister(self, Register_Rbx);
+    EmitPushRegister(self, Register_R12);
+    EmitPushRegister(self, Register_R13);
+    EmitPushRegister(self, Register_R14);
+    EmitPushRegister(self, Register_R15);
+
+    EmitMove(self, true, REGISTER_CONTEXT, Register_Rdi);
+    EmitLoad(self, REGISTER_SP, REGISTER_CONTEXT, offsetof(JitContext, sp));
+    EmitLoad(self, REGISTER_LOCALS, REGISTER_CONTEXT, offsetof(JitContext, locals));
+    EmitLoad(self, REGISTER_CONSTANTS, REGISTER_CONTEXT, offsetof(JitContext, constants));
+    EmitLoad(self, REGISTER_FRAME, REGISTER_CONTEXT, offsetof(JitContext, frame));
+
+    // jmp rsi
+    EmitByte(self, 0xFF);
+    EmitModRMRegister(self, 4, Register_Rsi);
+}
+
+static void EmitEpilogue(Assembler *self) {
+    EmitStore(self, REGISTER_CONTEXT, offsetof(JitContext, sp), REGISTER_SP);
+
+    EmitPopRegister(self, Register_R15);
+    EmitPopRegister(self, Register_R14);
+    EmitPopRegister(self, Register_R13);
+    EmitPopRegister(self, Register_R12);
+    EmitPopRegister(self, Register_Rbx);
+
+    // ret
+    EmitByte(self, 0xC3);
+}
+
+// Instruction lengths by the operand kinds of Opcode_LIST, closures and Wide vary.
+#define LENGTH_Simple 1
+#define LENGTH_Constant 2
+#define LENGTH_Byte 2
+#define LENGTH_Jump 3
+#define LENGTH_Loop 3
+#define LENGTH_Invoke 3
+#define LENGTH_LocalLocal 3
+#define LENGTH_LocalConstant 3
+#define LENGTH_JumpLocalConstant 5
+#define LENGTH_Closure 0
+#define LENGTH_Wide 0
+
+/// 0 if the instruction is unknown or does not fit into the chunk.
+static size_t InstructionLength(const Chunk *chunk, size_t offset) {
+    const uint8_t *ip = chunk->code + offset;
+    const size_t left = chunk->code_length - offset;
+    size_t length = 0;
+
+    if (ip[0] == Opcode_BuildClosure) {
+        length = left < 2 ? 0 : 2 + 2 * (size_t) ip[1];
+    } else if (ip[0] == Opcode_Wide) {
+        if (left < 2) {
+            return 0;
+        }
+
+        switch ((Opcode) ip[1]) {
+#define WIDE_LENGTH(name, width) case Opcode_##name: length = 2 + Opcode_WIDE_##width; break;
+
+            Opcode_WIDE_LIST(WIDE_LENGTH)
+
+#undef WIDE_LENGTH
+
+            default:
+                return 0;
+        }
+
+        // Operands after the widened one keep their size.
+        if (ip[1] == Opcode_Invoke) {
+            length += 1;
+        } else if (ip[1] == Opcode_LessLocalConstJumpIfFalse) {
+            length += 2;
+        }
+    } else {
+        switch ((Opcode) ip[0]) {
+#define OPCODE_LENGTH(name, kind) case Opcode_##name: length = LENGTH_##kind; break;
+
+            Opcode_LIST(OPCODE_LENGTH)
+
+#undef OPCODE_LENGTH
+
+            default:
+                return 0;
+        }
+    }
+
+    return length <= left ? length : 0;
+}
+
+static uint16_t ReadShort(const uint8_t *ip) {
+    return (uint16_t) (ip[0] | (ip[1] << 8));
+}
+
+/// Returns false if the instruction only leaves for the interpreter.
+static bool EmitInstruction(Assembler *self, const Chunk *chunk, uint32_t offset, uint32_t next) {
+    const uint8_t *ip = chunk->code + offset;
+    const Opcode opcode = ip[0];
+
+    switch (opcode) {
+        case Opcode_PushConstant:
+            EmitLoad(self, Register_Rax, REGISTER_CONSTANTS, ip[1] * (int32_t) sizeof(Value));
+            EmitPush(self, Register_Rax);
+            break;
+
+        case Opcode_PushTrue:
+        case Opcode_PushFalse:
+        case Opcode_PushNull: {
+            const Value value = opcode == Opcode_PushNull ? ValueNull() : ValueBool(opcode == Opcode_PushTrue);
+            EmitMoveImmediate(self, Register_Rax, (uint32_t) value.bits);
+            EmitPush(self, Register_Rax);
+            break;
+        }
+
+        case Opcode_Plus:
+            break;
+
+        case Opcode_Pop:
+            EmitDrop(self, 1);
+            break;
+
+        case Opcode_Top:
+            EmitLoad(self, Register_Rax, REGISTER_SP, -1 * (int32_t) sizeof(Value));
+            EmitPush(self, Register_Rax);
+            break;
+
+        case Opcode_GetLocal:
+            EmitLoad(self, Register_Rax, REGISTER_LOCALS, ip[1] * (int32_t) sizeof(Value));
+            EmitPush(self, Register_Rax);
+            break;
+
+        case Opcode_SetLocal:
+            EmitLoad(self, Register_Rax, REGISTER_SP, -1 * (int32_t) sizeof(Value));
+            EmitStore(self, REGISTER_LOCALS, ip[1] * (int32_t) sizeof(Value), Register_Rax);
+            break;
+
+        case Opcode_SetLocalPop:
+            EmitDrop(self, 1);
+            EmitLoad(self, Register_Rax, REGISTER_SP, 0);
+            EmitStore(self, REGISTER_LOCALS, ip[1] * (int32_t) sizeof(Value), Register_Rax);
+            break;
+
+        case Opcode_GetGlobal:
+            EmitLoad(self, Register_Rax, REGISTER_FRAME, offsetof(CallFrame, function));
+            EmitLoad(self, Register_Rax, Register_Rax, offsetof(ObjectFunction, module));
+            EmitLoad(self, Register_Rax, Register_Rax, offsetof(ObjectModule, globals));
+            EmitLoad(self, Register_Rax, Register_Rax, ip[1] * (int32_t) sizeof(Value));
+            EmitPush(self, Register_Rax);
+            break;
+
+        case Opcode_SetGlobal:
+            EmitSetGlobal(self, ip[1]);
+            break;
+
+        case Opcode_SetGlobalPop:
+            EmitSetGlobal(self, ip[1]);
+            EmitDrop(self, 1);
+            break;
+
+        case Opcode_Print:
+            EmitDrop(self, 1);
+            EmitLoad(self, Register_Rdi, REGISTER_SP, 0);
+            EmitCall(self, (const void *) JitPrint);
+            break;
+
+        case Opcode_Add:
+        case Opcode_Subtract:
+        case Opcode_Multiply:
+            EmitBinaryArithmetic(self, opcode, offset);
+            break;
+
+        case Opcode_Negate:
+            EmitLoad(self, Register_Rax, REGISTER_SP, -1 * (int32_t) sizeof(Value));
+            EmitIntGuard(self, Register_Rax, offset);
+            EmitAluImmediate(self, AluOp_Sub, true, Register_Rax, VALUE_TAG_INT);
+            EmitNegate(self, Register_Rax);
+            EmitExitIf(self, Condition_Overflow, offset);
+            EmitAluImmediate(self, AluOp_Or, true, Register_Rax, VALUE_TAG_INT);
+            EmitStore(self, REGISTER_SP, -1 * (int32_t) sizeof(Value), Register_Rax);
+            break;
+
+        case Opcode_Not:
+            EmitLoad(self, Register_Rax, REGISTER_SP, -1 * (int32_t) sizeof(Value));
+            EmitFalseTest(self, Register_Rax);
+            EmitBoolFromCondition(self, Condition_Equal);
+            EmitStore(self, REGISTER_SP, -1 * (int32_t) sizeof(Value), Register_Rax);
+            break;
+
+        case Opcode_Less:
+            EmitComparison(self, Condition_Less, offset, true);
+            break;
+
+        case Opcode_Greater:
+            EmitComparison(self, Condition_Greater, offset, true);
+            break;
+
+        case Opcode_LessEqual:
+            EmitComparison(self, Condition_LessEqual, offset, true);
+            break;
+
+        case Opcode_GreaterEqual:
+            EmitComparison(self, Condition_GreaterEqual, offset, true);
+            break;
+
+        // Every value has one encoding, so any two values are equal when their bits are.
+        case Opcode_Equal:
+            EmitComparison(self, Condition_Equal, offset, false);
+            break;
+
+        case Opcode_NotEqual:
+            EmitComparison(self, Condition_NotEqual, offset, false);
+            break;
+
+        case Opcode_Jump:
+            EmitJump(self, Condition_Always, next + ReadShort(ip + 1));
+            break;
+
+        case Opcode_Loop:
+            EmitJump(self, Condition_Always, next - ReadShort(ip + 1));
+            break;
+
+        case Opcode_JumpIfFalse:
+        case Opcode_JumpIfTrue:
+            EmitLoad(self, Register_Rax, REGISTER_SP, -1 * (int32_t) sizeof(Value));
+            EmitFalseTest(self, Register_Rax);
+            EmitJump(self, opcode == Opcode_JumpIfFalse ? Condition_Equal : Condition_NotEqual,
+                     next + ReadShort(ip + 1));
+            break;
+
+        case Opcode_JumpIfFalsePop:
+            EmitDrop(self, 1);
+            EmitLoad(self, Register_Rax, REGISTER_SP, 0);
+            EmitFalseTest(self, Register_Rax);
+            EmitJump(self, Condition_Equal, next + ReadShort(ip + 1));
+            break;
+
+        case Opcode_AddLocalLocal:
+            EmitLocalsOperands(self, ip[1], ip[2], offset);
+            EmitIntArithmetic(self, Opcode_Add, offset);
+            EmitPush(self, Register_Rax);
+            break;
+
+        case Opcode_IncrementLocal:
+            EmitLocalConstantOperands(self, ip[1], ip[2], offset);
+            EmitIntArithmetic(self, Opcode_Add, offset);
+            EmitStore(self, REGISTER_LOCALS, ip[1] * (int32_t) sizeof(Value), Register_Rax);
+            break;
+
+        case Opcode_LessJumpIfFalse:
+            EmitStackOperands(self, offset);
+            EmitDrop(self, 2);
+            EmitAlu(self, AluOp_Cmp, true, Register_Rax, Register_Rcx);
+            EmitJump(self, Condition_GreaterEqual, next + ReadShort(ip + 1));
+            break;
+
+        case Opcode_LessLocalConstJumpIfFalse:
+            EmitLocalConstantOperands(self, ip[3], ip[4], offset);
+            EmitAlu(self, AluOp_Cmp, true, Register_Rax, Register_Rcx);
+            EmitJump(self, Condition_GreaterEqual, next + ReadShort(ip + 1));
+            break;
+
+        default:
+            EmitExit(self, offset);
+            return false;
+    }
+
+    return true;
+}
+
+static bool PatchFixups(Assembler *self, const uint32_t *positions, size_t code_length) {
+    for (size_t i = 0; i < self->jumps.length; ++i) {
+        const Fixup fixup = self->jumps.fixups[i];
+        if (fixup.target >= code_length || positions[fixup.target] == JIT_NO_ENTRY) {
+            return false;
+        }
+
+        PatchU32(self, fixup.position, positions[fixup.target] - (fixup.position + 4));
+    }
+
+    // Exit stubs go after the code, one per guard.
+    for (size_t i = 0; i < self->exits.length; ++i) {
+        const Fixup fixup = self->exits.fixups[i];
+        PatchU32(self, fixup.position, (uint32_t) (self->length - (fixup.position + 4)));
+        EmitExit(self, fixup.target);
+    }
+
+    return true;
+}
+
+static JitCode *Install(const Assembler *assembler, uint32_t *entries) {
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t size = (assembler->length + page - 1) / page * page;
+
+    JitCode *code = malloc(sizeof(JitCode));
+    if (code == NULL) {
+        return NULL;
+    }
+
+    uint8_t *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        free(code);
+        return NULL;
+    }
+
+    memcpy(memory, assembler->code, assembler->length);
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        free(code);
+        return NULL;
+    }
+
+    code->memory = memory;
+    code->size = size;
+    code->entries = entries;
+    return code;
+}
+
+void JitCompile(VirtualMachine *vm, ObjectFunction *function) {
+    (void) vm;
+
+    const Chunk *chunk = &function->chunk;
+    if (chunk->code_length == 0 || chunk->code_length >= JIT_NO_ENTRY) {
+        return;
+    }
+
+    // Jumps go to the code of any instruction, the interpreter only enters at instructions that
+    // do not leave right away.
+    uint32_t *positions = malloc(sizeof(uint32_t) * chunk->code_length);
+    uint32_t *entries = malloc(sizeof(uint32_t) * chunk->code_length);
+    if (positions == NULL || entries == NULL) {
+        free(positions);
+        free(entries);
+        return;
+    }
+
+    for (size_t i = 0; i < chunk->code_length; ++i) {
+        positions[i] = entries[i] = JIT_NO_ENTRY;
+    }
+
+    Assembler assembler;
+    AssemblerInit(&assembler);
+
+    EmitPrologue(&assembler);
+    assembler.epilogue = assembler.length;
+    EmitEpilogue(&assembler);
+
+    bool translated = true;
+
+    for (uint32_t offset = 0; offset < chunk->code_length;) {
+        const size_t length = InstructionLength(chunk, offset);
+        if (length == 0) {
+            translated = false;
+            break;
+        }
+
+        positions[offset] = (uint32_t) assembler.length;
+        if (EmitInstruction(&assembler, chunk, offset, offset + length)) {
+            entries[offset] = positions[offset];
+        }
+
+        offset += length;
+    }
+
+    translated = translated && PatchFixups(&assembler, positions, chunk->code_length) && !assembler.failed;
+    free(positions);
+
+    JitCode *code = translated ? Install(&assembler, entries) : NULL;
+
+#ifdef JIT_LOG
+    fprintf(DEBUG_OUT, "== JIT: %s.%s, %zu bytes of bytecode, %s.\n", function->module->name->str,
+            function->name->str, chunk->code_length, code != NULL ? "compiled" : "failed");
+#endif
+
+    if (code == NULL) {
+        free(entries);
+    }
+
+    function->jit = code;
+    AssemblerDeinit(&assembler);
+}
+
+const uint8_t *JitRun(VirtualMachine *vm, CallFrame *frame, const uint8_t *ip, Value **sp) {
+    const JitCode *code = frame->function->jit;
+    const Chunk *chunk = &frame->function->chunk;
+
+    const uint32_t entry = code->entries[ip - chunk->code];
+    if (entry == JIT_NO_ENTRY) {
+        return ip;
+    }
+
+    JitContext context = {*sp, frame->locals, chunk->constants, frame, vm};
+    const uint32_t offset = ((JitFunction) code->memory)(&context, code->memory + entry);
+
+    *sp = context.sp;
+    return chunk->code + offset;
+}
+
+void JitCodeFree(JitCode *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    munmap(self->memory, self->size);
+    free(self->entries);
+    free(self);
+}
+
+#else
+
+void JitCodeFree(JitCode *self) {
+    assert(self == NULL);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef LOOP_JIT_H
+#define LOOP_JIT_H
+
+#include "Common.h"
+
+#include "VirtualMachine.h"
+
+// VM_JIT is set from CMake (LOOP_JIT). The code generator only knows x86-64 with the System V
+// calling convention and the tagged value layout.
+#if defined(VM_JIT) && defined(VALUE_TAGGED) && defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED
+#endif
+
+#define JIT_NO_ENTRY UINT32_MAX
+
+/// Machine code of one function, produced once the function gets hot.
+/// Every instruction is translated in place and works on the interpreter's value stack, so the
+/// interpreter can enter the code at any instruction and take over at any instruction. Int
+/// arithmetic, comparisons, locals, constants, globals and jumps run natively, Print and global
+/// stores call C helpers. Every other instruction, and every int fast path whose operands turn
+/// out to be something else, leaves the code with the offset of the instruction for the
+/// interpreter to execute.
+typedef struct JitCode {
+    uint8_t *memory; // Mapped executable pages.
+    size_t size;
+    uint32_t *entries; // Offset in memory of the instruction at each bytecode offset or JIT_NO_ENTRY.
+} JitCode;
+
+/// Leaves function->jit NULL if the chunk cannot be translated.
+void JitCompile(VirtualMachine *vm, ObjectFunction *function);
+
+/// Runs the code of the function of frame from ip, returns the ip the interpreter continues at.
+const uint8_t *JitRun(VirtualMachine *vm, CallFrame *frame, const uint8_t *ip, Value **sp);
+
+void JitCodeFree(JitCode *self);
+
+#endif // LOOP_JIT_H
@@ -1,29 +1,77 @@
 #include "MemoryManager.h"
 
+#include <time.h>
+
+#if defined(__APPLE__) || (defined(__unix__) && !defined(__linux__))
+#include <sys/resource.h>
+#endif
+
+#if defined(COMPACTING_SUPPORTED) && defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
 #include "Object.h"
 #include "VirtualMachine.h"
 
 static void FreeAllObjects(MemoryManager *self);
 
+static size_t ResidentBytes(bool peak);
+
 void MemoryManagerInit(MemoryManager *self, VirtualMachine *vm) {
     self->objects = NULL;
+    self->old_objects = NULL;
+    self->remembered = NULL;
+    self->remembered_capacity = 0;
+    self->remembered_count = 0;
     self->vm = vm;
     self->gray_stack = NULL;
     self->gray_stack_capacity = 0;
     self->gray_stack_count = 0;
     self->bytes_allocated = 0;
-    self->next_gc = 1024 * 1024;
+    self->live_bytes = 0;
+    self->next_minor_gc = GC_NURSERY_SIZE;
+    self->collections_count = 0;
+    self->peak_bytes_allocated = 0;
+    self->collections_nanoseconds = 0;
+    self->max_pause_nanoseconds = 0;
+    self->phase = GCPhase_Idle;
+    self->unmark_cursor = NULL;
+    self->next_mark_step = 0;
+    self->unswept = NULL;
+    self->next_sweep_step = 0;
+    self->marked_heap_bytes = 0;
+    self->swept_bytes = 0;
+    self->compaction_requested = false;
+    self->compactions_count = 0;
+    GCPolicyInit(&self->policy);
     self->on = false;
+    SlabAllocatorInit(&self->slabs);
+    ParallelMarkerInit(&self->marker, self);
+    MemoryManagerSetPolicy(self, &self->policy);
 }
 
 void MemoryManagerDeinit(MemoryManager *self) {
+    ParallelMarkerDeinit(&self->marker);
     FreeAllObjects(self);
     free(self->gray_stack);
+    free(self->remembered);
+    SlabAllocatorDeinit(&self->slabs);
     MemoryManagerInit(self, NULL);
 }
 
-static void FreeAllObjects(MemoryManager *self) {
-    Object *current = self->objects;
+static void PaceNextCollection(MemoryManager *self, size_t live_bytes);
+
+void MemoryManagerSetPolicy(MemoryManager *self, const GCPolicy *policy) {
+    self->policy = *policy;
+
+    if (policy->threads != 0) {
+        self->marker.threads_count = policy->threads;
+    }
+
+    PaceNextCollection(self, self->live_bytes);
+}
+
+static void FreeList(MemoryManager *self, Object *current) {
     while (current != NULL) {
         Object *next = current->next;
         ObjectFree(current, self->vm);
@@ -31,23 +79,74 @@ static void FreeAllObjects(MemoryManager *self) {
     }
 }
 
+static void FreeAllObjects(MemoryManager *self) {
+    FreeList(self, self->objects);
+    FreeList(self, self->old_objects);
+    FreeList(self, self->unswept);
+}
+
 void *MemoryManagerAllocate(MemoryManager *self, size_t new_size) {
     return MemoryManagerReallocate(self, NULL, new_size, 0);
 }
 
-static void CollectGarbage(MemoryManager *self);
+static void CollectGarbage(MemoryManager *self, bool minor);
 
-void *MemoryManagerReallocate(MemoryManager *self, void *ptr, size_t new_size, size_t old_size) {
-#ifdef GC_STRESS
-    if (self->on && new_size > old_size) {
-        CollectGarbage(self);
+static void CollectMajor(MemoryManager *self);
+
+#ifdef GC_INCREMENTAL
+static void MarkStep(MemoryManager *self);
+#endif
+
+#ifdef GC_LAZY_SWEEP
+static void SweepStep(MemoryManager *self);
+#endif
+
+static void MaybeCollectGarbage(MemoryManager *self, size_t new_size, size_t old_size) {
+    // Only on growth, frees happen while sweeping.
+    if (!self->on || new_size <= old_size) {
+        return;
+    }
+
+    const bool stress = self->policy.stress;
+
+#ifdef GC_LAZY_SWEEP
+    if (self->unswept != NULL && (stress || self->bytes_allocated > self->next_sweep_step)) {
+        SweepStep(self);
+    }
+#endif
+
+#ifdef GC_INCREMENTAL
+    // No other collection starts until the incremental one is done.
+    if (self->phase != GCPhase_Idle) {
+        if (stress || self->bytes_allocated > self->next_mark_step) {
+            MarkStep(self);
+        }
+        return;
     }
+#endif
+
+    if (stress) {
+#ifdef GC_GENERATIONAL
+        if (self->collections_count % GC_STRESS_MAJOR_INTERVAL != 0) {
+            CollectGarbage(self, true);
+        } else {
+            CollectMajor(self);
+        }
 #else
-    if (self->on && self->bytes_allocated > self->next_gc)
-    {
-        CollectGarbage(self);
+        CollectMajor(self);
+#endif
+    } else if (self->bytes_allocated > self->next_gc) {
+        CollectMajor(self);
+    }
+#ifdef GC_GENERATIONAL
+    else if (self->bytes_allocated > self->next_minor_gc) {
+        CollectGarbage(self, true);
     }
 #endif
+}
+
+void *MemoryManagerReallocate(MemoryManager *self, void *ptr, size_t new_size, size_t old_size) {
+    MaybeCollectGarbage(self, new_size, old_size);
 
     self->bytes_allocated += new_size - old_size;
 
@@ -69,24 +168,289 @@ void MemoryManagerFree(MemoryManager *self, const void *ptr, size_t old_size) {
     MemoryManagerReallocate(self, (void *) ptr, 0, old_size);
 }
 
-static void MarkStage(MemoryManager *self);
+void *MemoryManagerAllocateObject(MemoryManager *self, size_t size) {
+#ifdef MEMORY_SLAB_ALLOCATOR
+    if (size <= SLAB_MAX_CELL_SIZE) {
+        MaybeCollectGarbage(self, size, 0);
+        self->bytes_allocated += size;
+        return SlabAllocatorAllocate(&self->slabs, size);
+    }
+#endif
+
+    return MemoryManagerAllocate(self, size);
+}
+
+void MemoryManagerFreeObject(MemoryManager *self, void *ptr, size_t size) {
+#ifdef MEMORY_SLAB_ALLOCATOR
+    if (size <= SLAB_MAX_CELL_SIZE) {
+        self->bytes_allocated -= size;
+        SlabAllocatorFree(&self->slabs, ptr, size);
+        return;
+    }
+#endif
+
+    MemoryManagerFree(self, ptr, size);
+}
+
+void MemoryManagerRemember(MemoryManager *self, Object *owner) {
+    if (self->remembered_count + 1 > self->remembered_capacity) {
+        self->remembered_capacity = GROW_CAPACITY(self->remembered_capacity);
+        self->remembered = (Object **) realloc(self->remembered, sizeof(Object *) * self->remembered_capacity);
+
+        if (self->remembered == NULL) {
+            fprintf(stderr, "FATAL ERROR: out of memory\n");
+            exit(1);
+        }
+    }
+
+    owner->remembered = true;
+    self->remembered[self->remembered_count++] = owner;
+}
+
+static void PushGrayStack(MemoryManager *self, Object *object) {
+    if (self->gray_stack_count + 1 > self->gray_stack_capacity) {
+        self->gray_stack_capacity = GROW_CAPACITY(self->gray_stack_capacity);
+        self->gray_stack = (Object **) realloc(self->gray_stack, sizeof(Object *) * self->gray_stack_capacity);
+
+        if (self->gray_stack == NULL) {
+            fprintf(stderr, "FATAL ERROR: out of memory\n");
+            exit(1);
+        }
+    }
+
+    object->gray = true;
+    self->gray_stack[self->gray_stack_count++] = object;
+}
+
+void MemoryManagerPushGray(MemoryManager *self, Object *object) {
+    assert(object->marked);
+
+#ifdef PARALLEL_MARK_SUPPORTED
+    if (self->marker.draining) {
+        object->gray = true;
+        ParallelMarkerPush(&self->marker, object);
+        return;
+    }
+#endif
+
+    PushGrayStack(self, object);
+}
+
+void MemoryManagerWriteStats(const MemoryManager *self, FILE *out, bool json) {
+    const size_t peak = self->bytes_allocated > self->peak_bytes_allocated
+                            ? self->bytes_allocated
+                            : self->peak_bytes_allocated;
+    const double seconds = (double) self->collections_nanoseconds / 1e9;
+    const double max_pause = (double) self->max_pause_nanoseconds / 1e9;
+    const size_t peak_rss = ResidentBytes(true);
+    const size_t rss = ResidentBytes(false);
+
+    if (json) {
+        fprintf(out,
+                "{\"collections\": %zu, \"gc_seconds\": %.9f, \"max_pause_seconds\": %.9f, "
+                "\"peak_heap_bytes\": %zu, \"compactions\": %zu, \"peak_rss_bytes\": %zu, \"rss_bytes\": %zu}\n",
+                self->collections_count, seconds, max_pause, peak, self->compactions_count, peak_rss, rss);
+    } else {
+        fprintf(out, "collections %zu\ngc seconds %.6f\nmax pause seconds %.6f\npeak heap bytes %zu\n"
+                     "compactions %zu\npeak rss bytes %zu\nrss bytes %zu\n",
+                self->collections_count, seconds, max_pause, peak, self->compactions_count, peak_rss, rss);
+    }
+}
 
-static void SweepStage(MemoryManager *self);
+// The parent's peak ends up in ru_maxrss of a child on Linux, VmHWM starts over at exec.
+// Zero when the platform has neither, the current RSS is only known on Linux.
+static size_t ResidentBytes(bool peak) {
+#if defined(__linux__)
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status == NULL) {
+        return 0;
+    }
+
+    const char *format = peak ? "VmHWM: %zu kB" : "VmRSS: %zu kB";
+    char line[256];
+    size_t kilobytes = 0;
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (sscanf(line, format, &kilobytes) == 1) {
+            break;
+        }
+    }
 
-static void UpdateNextGC(MemoryManager *self);
+    fclose(status);
+    return kilobytes * 1024;
+#elif defined(__APPLE__) || defined(__unix__)
+    if (!peak) {
+        return 0;
+    }
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    return (size_t) usage.ru_maxrss;
+#else
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+#else
+    (void) peak;
+    return 0;
+#endif
+}
+
+uint64_t MemoryManagerNowNanoseconds(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+static void ForgetOldObjects(MemoryManager *self);
+
+static void MarkStage(MemoryManager *self, bool minor);
+
+static void TraverseRoots(MemoryManager *self);
+
+static void FinishCollection(MemoryManager *self, bool minor);
+
+static void FinishSweeping(MemoryManager *self);
+
+static void SweepStage(MemoryManager *self, bool minor);
+
+static void UpdateNextGC(MemoryManager *self, bool minor);
+
+static void RequestCompaction(MemoryManager *self);
+
+// The heap only grows between collections.
+static void UpdatePeak(MemoryManager *self) {
+    if (self->bytes_allocated > self->peak_bytes_allocated) {
+        self->peak_bytes_allocated = self->bytes_allocated;
+    }
+}
+
+static void EndPause(MemoryManager *self, uint64_t start) {
+    const uint64_t pause = MemoryManagerNowNanoseconds() - start;
+    self->collections_nanoseconds += pause;
+
+    if (pause > self->max_pause_nanoseconds) {
+        self->max_pause_nanoseconds = pause;
+    }
+}
+
+// Generational mode keeps marks set on survivors and moves them to old_objects.
+// A minor collection then stops at marked (old) objects, starts from the roots and
+// the remembered set, and only sweeps the young list. A major one clears the old
+// marks first and collects everything.
+static void CollectGarbage(MemoryManager *self, bool minor) {
+#ifdef GC_LOG
+    fprintf(DEBUG_OUT, "== GC: Begin%s.\n", minor ? " (minor)" : "");
+#endif
+
+    const uint64_t start = MemoryManagerNowNanoseconds();
+
+    UpdatePeak(self);
+
+    if (!minor) {
+        FinishSweeping(self);
+        ForgetOldObjects(self);
+    }
+
+    MarkStage(self, minor);
+    FinishCollection(self, minor);
+    EndPause(self, start);
+}
+
+#ifdef GC_INCREMENTAL
+static void BeginMarking(MemoryManager *self);
+#endif
+
+static void CollectMajor(MemoryManager *self) {
+#ifdef GC_INCREMENTAL
+    if (self->policy.pause_nanoseconds != 0) {
+        BeginMarking(self);
+        return;
+    }
+#endif
+
+    CollectGarbage(self, false);
+}
+
+static void ForgetOldObjects(MemoryManager *self) {
+    for (Object *object = self->old_objects; object != NULL; object = object->next) {
+        object->marked = false;
+        object->remembered = false;
+    }
+
+    self->remembered_count = 0;
+}
+
+static void MarkStage(MemoryManager *self, bool minor) {
+    VirtualMachineMarkRoots(self->vm, self);
+
+    if (minor) {
+        for (size_t i = 0; i < self->remembered_count; ++i) {
+            Object *object = self->remembered[i];
+            object->remembered = false;
+            ObjectMarkTraverse(object, self);
+        }
+
+        self->remembered_count = 0;
+    }
+
+    TraverseRoots(self);
+}
+
+// Gray objects are marked, the ones they point to are not necessarily.
+static void TraverseGray(MemoryManager *self) {
+    Object *obj = self->gray_stack[--self->gray_stack_count];
+    obj->gray = false;
+    ObjectMarkTraverse(obj, self);
+}
+
+// Traverses gray objects until none is left or the deadline passes. The parallel marker takes
+// over once GC_PARALLEL_MARK_THRESHOLD of them are traversed, small graphs do not wake it.
+static void Drain(MemoryManager *self, uint64_t deadline) {
+    size_t traversed = 0;
+
+#ifdef PARALLEL_MARK_SUPPORTED
+    // Stress marks small graphs in parallel as well, so the threads get exercised.
+    const size_t threshold = self->policy.stress ? 0 : GC_PARALLEL_MARK_THRESHOLD;
+#endif
+
+    while (self->gray_stack_count) {
+#ifdef PARALLEL_MARK_SUPPORTED
+        if (traversed == threshold && self->marker.threads_count > 1) {
+            ParallelMarkerDrain(&self->marker, deadline);
+            return;
+        }
+#endif
+
+        TraverseGray(self);
+
+        if (++traversed % GC_MARK_CLOCK_INTERVAL == 0 && deadline != UINT64_MAX &&
+            MemoryManagerNowNanoseconds() >= deadline) {
+            return;
+        }
+    }
+}
+
+static void TraverseRoots(MemoryManager *self) {
+    Drain(self, UINT64_MAX);
+}
 
-static void CollectGarbage(MemoryManager *self) {
+static void FinishCollection(MemoryManager *self, bool minor) {
 #ifdef GC_LOG
-    fprintf(DEBUG_OUT, "== GC: Begin.\n");
     size_t before = self->bytes_allocated;
 #endif
 
-    MarkStage(self);
     // Pretty bad code. It is part of VM, but it is there.
     HashTableRemoveWhite(&self->vm->strings, self);
-    HashTableRemoveWhite(&self->vm->modules, self);
-    SweepStage(self);
-    UpdateNextGC(self);
+    SweepStage(self, minor);
+    UpdateNextGC(self, minor);
+    ++self->collections_count;
+
+    if (!minor) {
+        RequestCompaction(self);
+    }
 
 #ifdef GC_LOG
     fprintf(DEBUG_OUT, "== GC: End.\n");
@@ -95,21 +459,210 @@ static void CollectGarbage(MemoryManager *self) {
 #endif
 }
 
-static void TraverseRoots(MemoryManager *self);
+#ifdef GC_INCREMENTAL
 
-static void MarkStage(MemoryManager *self) {
-    VirtualMachineMarkRoots(self->vm, self);
-    TraverseRoots(self);
+// An incremental major collection is a tri-color one. White objects are not marked, gray ones are
+// on the gray stack and black ones are marked and traversed. Objects allocated while marking start
+// white, the write barrier turns black objects that get a new value gray again. The roots have no
+// barrier, the last step marks them again and traverses everything that is still gray in one go,
+// then frees the white objects. With GC_GENERATIONAL the steps clear the marks of the old objects
+// first.
+
+static void IncrementalStep(MemoryManager *self, uint64_t start);
+
+static void BeginMarking(MemoryManager *self) {
+#ifdef GC_LOG
+    fprintf(DEBUG_OUT, "== GC: Begin (incremental).\n");
+#endif
+
+    const uint64_t start = MemoryManagerNowNanoseconds();
+
+    UpdatePeak(self);
+    FinishSweeping(self);
+    self->phase = GCPhase_Unmarking;
+    self->unmark_cursor = self->old_objects;
+    IncrementalStep(self, start);
 }
 
-static void TraverseRoots(MemoryManager *self) {
-    while (self->gray_stack_count) {
-        Object *obj = self->gray_stack[--self->gray_stack_count];
-        ObjectMarkTraverse(obj, self);
+static void MarkStep(MemoryManager *self) {
+    IncrementalStep(self, MemoryManagerNowNanoseconds());
+}
+
+// ForgetOldObjects in pieces, returns true once every old object is unmarked.
+static bool UnmarkUntil(MemoryManager *self, uint64_t deadline) {
+    size_t visited = 0;
+
+    while (self->unmark_cursor != NULL) {
+        Object *object = self->unmark_cursor;
+        object->marked = false;
+        object->remembered = false;
+        self->unmark_cursor = object->next;
+
+        if (self->policy.stress) {
+            if (++visited == GC_STRESS_MARK_STEP) {
+                break;
+            }
+        } else if (++visited % GC_MARK_CLOCK_INTERVAL == 0 && MemoryManagerNowNanoseconds() >= deadline) {
+            break;
+        }
+    }
+
+    return self->unmark_cursor == NULL;
+}
+
+// Returns true once the gray stack is empty.
+static bool MarkUntil(MemoryManager *self, uint64_t deadline) {
+    if (self->policy.stress) {
+        for (size_t i = 0; i < GC_STRESS_MARK_STEP && self->gray_stack_count; ++i) {
+            TraverseGray(self);
+        }
+    } else {
+        Drain(self, deadline);
+    }
+
+    return self->gray_stack_count == 0;
+}
+
+static void IncrementalStep(MemoryManager *self, uint64_t start) {
+    // A collection that falls behind the allocations is finished right away.
+    const GCPolicy *policy = &self->policy;
+    const bool behind = (double) self->bytes_allocated > (double) self->next_gc * policy->growth ||
+                        (policy->max_heap != 0 && self->bytes_allocated > policy->max_heap);
+    const uint64_t deadline = behind ? UINT64_MAX : start + policy->pause_nanoseconds;
+
+    if (self->phase == GCPhase_Unmarking && UnmarkUntil(self, deadline)) {
+        self->remembered_count = 0;
+        self->phase = GCPhase_Marking;
+        VirtualMachineMarkRoots(self->vm, self);
     }
+
+    if (self->phase == GCPhase_Marking && MarkUntil(self, deadline)) {
+        VirtualMachineMarkRoots(self->vm, self);
+        TraverseRoots(self);
+        self->phase = GCPhase_Idle;
+        FinishCollection(self, false);
+    }
+
+    self->next_mark_step = self->bytes_allocated + GC_MARK_STEP_SIZE;
+    EndPause(self, start);
 }
 
-static void SweepStage(MemoryManager *self) {
+#endif
+
+#ifdef GC_LAZY_SWEEP
+
+// Sweeps at most count objects left by a major collection, the survivors go back to the list
+// they were taken from.
+static void SweepUnswept(MemoryManager *self, size_t count) {
+    if (self->unswept == NULL) {
+        return;
+    }
+
+#ifdef GC_GENERATIONAL
+    Object **survivors = &self->old_objects;
+#else
+    Object **survivors = &self->objects;
+#endif
+
+    for (; self->unswept != NULL && count > 0; --count) {
+        Object *object = self->unswept;
+        self->unswept = object->next;
+
+        if (object->marked) {
+#ifndef GC_GENERATIONAL
+            object->marked = false;
+#endif
+            object->next = *survivors;
+            *survivors = object;
+        } else {
+            const size_t before = self->bytes_allocated;
+            ObjectFree(object, self->vm);
+            self->swept_bytes += before - self->bytes_allocated;
+        }
+    }
+
+    // Only now the live bytes are known.
+    if (self->unswept == NULL) {
+        PaceNextCollection(self, self->marked_heap_bytes - self->swept_bytes);
+        RequestCompaction(self);
+    }
+}
+
+static void SweepStep(MemoryManager *self) {
+    const uint64_t start = MemoryManagerNowNanoseconds();
+
+    SweepUnswept(self, self->policy.stress ? GC_STRESS_SWEEP_STEP : GC_SWEEP_STEP_COUNT);
+
+    self->next_sweep_step = self->bytes_allocated + GC_SWEEP_STEP_SIZE;
+    EndPause(self, start);
+}
+
+// Nothing is freed in the pause, the objects of the list are left to the sweep steps.
+static void SweepLater(MemoryManager *self, Object **list) {
+    assert(self->unswept == NULL);
+
+    self->unswept = *list;
+    *list = NULL;
+    self->next_sweep_step = self->bytes_allocated + GC_SWEEP_STEP_SIZE;
+}
+
+#endif
+
+// Marks are about to change, the sweep steps would not tell the dead objects apart anymore.
+static void FinishSweeping(MemoryManager *self) {
+#ifdef GC_LAZY_SWEEP
+    SweepUnswept(self, SIZE_MAX);
+#else
+    (void) self;
+#endif
+}
+
+#ifdef GC_GENERATIONAL
+
+static void SweepList(MemoryManager *self, Object **list) {
+    Object **link = list;
+
+    while (*link != NULL) {
+        Object *object = *link;
+
+        if (object->marked) {
+            link = &object->next;
+        } else {
+            *link = object->next;
+            ObjectFree(object, self->vm);
+        }
+    }
+}
+
+static void SweepStage(MemoryManager *self, bool minor) {
+    if (!minor) {
+#ifdef GC_LAZY_SWEEP
+        SweepLater(self, &self->old_objects);
+#else
+        SweepList(self, &self->old_objects);
+#endif
+    }
+
+    SweepList(self, &self->objects);
+
+    // Every young survivor is promoted.
+    Object *object = self->objects;
+    while (object != NULL) {
+        Object *next = object->next;
+        object->next = self->old_objects;
+        self->old_objects = object;
+        object = next;
+    }
+
+    self->objects = NULL;
+}
+
+#else
+
+static void SweepStage(MemoryManager *self, bool minor) {
+#ifdef GC_LAZY_SWEEP
+    SweepLater(self, &self->objects);
+#else
     Object *previous = NULL;
     Object *object = self->objects;
 
@@ -131,8 +684,147 @@ static void SweepStage(MemoryManager *self) {
             ObjectFree(unreached, self->vm);
         }
     }
+#endif
+}
+
+#endif
+
+static void UpdateNextGC(MemoryManager *self, bool minor) {
+    if (!minor) {
+#ifdef GC_LAZY_SWEEP
+        // Until the sweep steps are done the dead objects count as live.
+        self->marked_heap_bytes = self->bytes_allocated;
+        self->swept_bytes = 0;
+#endif
+        PaceNextCollection(self, self->bytes_allocated);
+    }
+
+    self->next_minor_gc = self->bytes_allocated + GC_NURSERY_SIZE;
+}
+
+// The heap may grow to growth times the live bytes, at least by min_interval. max_heap brings the
+// collection forward, but not closer than min_interval, so a heap that stays full still runs.
+static void PaceNextCollection(MemoryManager *self, size_t live_bytes) {
+    const GCPolicy *policy = &self->policy;
+    const size_t least = live_bytes + policy->min_interval;
+
+    const double grown = (double) live_bytes * policy->growth;
+    size_t next = grown >= (double) SIZE_MAX ? SIZE_MAX : (size_t) grown;
+    if (next < least) {
+        next = least;
+    }
+
+    if (policy->max_heap != 0 && next > policy->max_heap) {
+        next = policy->max_heap > least ? policy->max_heap : least;
+    }
+
+    self->live_bytes = live_bytes;
+    self->next_gc = next;
+}
+
+// Once a major collection has swept, the free cells of the slabs are known. With stress every major
+// collection compacts, the compaction sweeps what is left.
+static void RequestCompaction(MemoryManager *self) {
+#ifdef COMPACTING_SUPPORTED
+    if (!self->policy.compact) {
+        return;
+    }
+
+    if (self->policy.stress) {
+        self->compaction_requested = true;
+        return;
+    }
+
+    const size_t slab_bytes = self->slabs.slabs_count * SLAB_SIZE;
+    const size_t free_bytes = slab_bytes - self->slabs.live_bytes;
+
+    if (self->unswept == NULL && slab_bytes >= GC_COMPACT_MIN_BYTES &&
+        (double) free_bytes > (double) slab_bytes * GC_COMPACT_FREE_RATIO) {
+        self->compaction_requested = true;
+    }
+#else
+    (void) self;
+#endif
+}
+
+Object *MemoryManagerEvacuate(MemoryManager *self, Object *object) {
+#ifdef COMPACTING_SUPPORTED
+    const size_t size = ObjectSize(object);
+    if (size <= SLAB_MAX_CELL_SIZE && SlabAllocatorSlabOf(object)->evacuating) {
+        object = ObjectMoveTo(object, SlabAllocatorAllocate(&self->slabs, size));
+    }
+#endif
+
+    PushGrayStack(self, object);
+    return object;
+}
+
+#ifdef COMPACTING_SUPPORTED
+
+// While compacting the gray stack holds the objects that were reached but not relocated yet. The
+// objects are traversed depth first, the ones that refer to each other get moved next to each other.
+static void RelocateReached(MemoryManager *self) {
+    while (self->gray_stack_count) {
+        Object *object = self->gray_stack[--self->gray_stack_count];
+        ObjectRelocateTraverse(object, self);
+    }
+}
+
+// Objects nothing reaches anymore still point to the others until they are swept, so every object
+// of the list is relocated, the links between them as well.
+static void RelocateList(MemoryManager *self, Object **list) {
+    for (Object **link = list; *link != NULL; link = &(*link)->next) {
+        *link = ObjectRelocate(*link, self);
+        RelocateReached(self);
+    }
 }
 
-static void UpdateNextGC(MemoryManager *self) {
-    self->next_gc *= GC_HEAP_GROW_FACTOR;
+static void ForgetReached(Object *list) {
+    for (Object *object = list; object != NULL; object = object->next) {
+        object->gray = false;
+    }
+}
+
+void MemoryManagerCompact(MemoryManager *self) {
+    // A collection started since and keeps its gray objects on the stack, it has to finish first.
+    if (self->phase != GCPhase_Idle) {
+        return;
+    }
+
+    assert(self->gray_stack_count == 0);
+
+    const uint64_t start = MemoryManagerNowNanoseconds();
+
+    // Finishing the sweep may ask for the compaction again.
+    FinishSweeping(self);
+    self->compaction_requested = false;
+
+    const double occupancy = self->policy.stress ? 1.0 : GC_COMPACT_OCCUPANCY;
+    if (SlabAllocatorBeginEvacuation(&self->slabs, occupancy) == 0) {
+        EndPause(self, start);
+        return;
+    }
+
+    VirtualMachineRelocateRoots(self->vm, self);
+    for (size_t i = 0; i < self->remembered_count; ++i) {
+        self->remembered[i] = ObjectRelocate(self->remembered[i], self);
+    }
+    RelocateReached(self);
+
+    RelocateList(self, &self->objects);
+    RelocateList(self, &self->old_objects);
+    ForgetReached(self->objects);
+    ForgetReached(self->old_objects);
+
+    SlabAllocatorEndEvacuation(&self->slabs);
+    ++self->compactions_count;
+
+#ifdef __GLIBC__
+    // Free pages between the blocks still in use go back to the system as well.
+    malloc_trim(0);
+#endif
+
+    EndPause(self, start);
 }
+
+#endif
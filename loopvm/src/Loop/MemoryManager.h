@@ -3,6 +3,16 @@
 
 #include "Common.h"
 
+#include "GCPolicy.h"
+#include "Object.h"
+#include "ParallelMarker.h"
+#include "SlabAllocator.h"
+
+// GC_COMPACTING is set from CMake (LOOP_COMPACTING_GC). Only objects in slabs are moved.
+#if defined(GC_COMPACTING) && defined(MEMORY_SLAB_ALLOCATOR)
+#define COMPACTING_SUPPORTED
+#endif
+
 #define GROW_CAPACITY(old_capacity) ((old_capacity) < 8 ? 8 : (old_capacity) * 2)
 
 #define REALLOC_ARRAY(vm, ptr, type, new_capacity, old_capacity) \
@@ -14,25 +24,106 @@
 #define ALLOC_ARRAY(vm, type, capacity) \
     (type*)MemoryManagerAllocate(&(vm)->memory_manager, sizeof(type) * (capacity))
 
+typedef enum GCPhase {
+    GCPhase_Idle,
+    GCPhase_Unmarking, // Clearing the marks of old objects before an incremental major collection.
+    GCPhase_Marking,
+} GCPhase;
+
 typedef struct MemoryManager {
-    Object *objects;
+    Object *objects; // Young objects with GC_GENERATIONAL, otherwise all of them.
+    Object *old_objects;
+    Object **remembered; // Old objects that may point to young ones.
+    size_t remembered_capacity;
+    size_t remembered_count;
     VirtualMachine *vm;
     Object **gray_stack;
     size_t gray_stack_capacity;
     size_t gray_stack_count;
     size_t bytes_allocated;
     size_t next_gc;
+    size_t live_bytes; // Left by the last major collection.
+    size_t next_minor_gc;
+    size_t collections_count;
+    size_t peak_bytes_allocated; // Taken before every collection.
+    uint64_t collections_nanoseconds;
+    uint64_t max_pause_nanoseconds;
+    GCPhase phase; // Of an incremental major collection between its first and last step.
+    Object *unmark_cursor;
+    size_t next_mark_step;
+    Object *unswept; // Objects of the last major collection with GC_LAZY_SWEEP, marked ones are alive.
+    size_t next_sweep_step;
+    size_t marked_heap_bytes; // Heap size when the unswept objects were left to the sweep steps.
+    size_t swept_bytes; // Freed by the sweep steps since.
+    bool compaction_requested; // The interpreter compacts at its next safepoint.
+    size_t compactions_count;
+    GCPolicy policy;
     bool on; // Used so that when loading objects from JSON memory manager offs.
+    SlabAllocator slabs; // Used with MEMORY_SLAB_ALLOCATOR.
+    ParallelMarker marker; // Used with GC_PARALLEL.
 } MemoryManager;
 
 void MemoryManagerInit(MemoryManager *self, VirtualMachine *vm);
 
 void MemoryManagerDeinit(MemoryManager *self);
 
+/// Takes effect from the next collection on.
+void MemoryManagerSetPolicy(MemoryManager *self, const GCPolicy *policy);
+
 void *MemoryManagerAllocate(MemoryManager *self, size_t new_size);
 
 void *MemoryManagerReallocate(MemoryManager *self, void *ptr, size_t new_size, size_t old_size);
 
 void MemoryManagerFree(MemoryManager *self, const void *ptr, size_t old_size);
 
+/// Small objects come from the slab allocator, others from realloc.
+void *MemoryManagerAllocateObject(MemoryManager *self, size_t size);
+
+void MemoryManagerFreeObject(MemoryManager *self, void *ptr, size_t size);
+
+void MemoryManagerRemember(MemoryManager *self, Object *owner);
+
+/// The object must be marked already.
+void MemoryManagerPushGray(MemoryManager *self, Object *object);
+
+/// Moves the object out of its slab if the slab is evacuated and queues it for
+/// ObjectRelocateTraverse, ObjectRelocate calls it for objects reached the first time.
+Object *MemoryManagerEvacuate(MemoryManager *self, Object *object);
+
+/// Moves the objects out of sparse slabs and releases them. Every object pointer outside of the
+/// heap that is not a root must be dead, so the interpreter calls it between instructions once a
+/// major collection requested it.
+void MemoryManagerCompact(MemoryManager *self);
+
+/// The clock pauses and marking deadlines are measured with.
+uint64_t MemoryManagerNowNanoseconds(void);
+
+/// Collections, the time spent in them, the peak heap size, the compactions and the peak and the
+/// current RSS for loopvm --gc-stats.
+void MemoryManagerWriteStats(const MemoryManager *self, FILE *out, bool json);
+
+/// Call after storing a value into an object that might have survived a collection.
+/// While an incremental collection is marking, a traversed owner turns gray again, so the stored
+/// value is marked before white objects are freed.
+static inline void MemoryManagerWriteBarrier(MemoryManager *self, Object *owner) {
+#ifdef GC_INCREMENTAL
+    // While old marks are cleared nothing is remembered, marking starts over from the roots anyway.
+    if (self->phase != GCPhase_Idle) {
+        if (self->phase == GCPhase_Marking && owner->marked && !owner->gray) {
+            MemoryManagerPushGray(self, owner);
+        }
+        return;
+    }
+#endif
+
+#ifdef GC_GENERATIONAL
+    if (owner->marked && !owner->remembered) {
+        MemoryManagerRemember(self, owner);
+    }
+#endif
+
+    (void) self;
+    (void) owner;
+}
+
 #endif // LOOP_MEMORYMANAGER_H
@@ -13,10 +13,14 @@
 #include "Objects/Upvalue.h"
 #include "Objects/Closure.h"
 #include "Objects/List.h"
+#include "Objects/Shape.h"
 
 Object *ObjectAllocateRaw(VirtualMachine *vm, ObjectType type, size_t size) {
-    Object *obj = MemoryManagerReallocate(&vm->memory_manager, NULL, size, 0);
+    Object *obj = MemoryManagerAllocateObject(&vm->memory_manager, size);
     obj->marked = false;
+    obj->remembered = false;
+    obj->gray = false;
+    obj->moved = false;
     obj->type = type;
     obj->next = vm->memory_manager.objects;
     vm->memory_manager.objects = obj;
@@ -37,7 +41,7 @@ void ObjectFreeRaw(VirtualMachine *vm, Object *obj, size_t size) {
 
     obj->next = NULL;
     obj->marked = false;
-    MemoryManagerFree(&vm->memory_manager, obj, size);
+    MemoryManagerFreeObject(&vm->memory_manager, obj, size);
 }
 
 Object *ObjectFromJSON(VirtualMachine *vm, ObjectModule *module, const cJSON *json) {
@@ -64,6 +68,20 @@ Object *ObjectFromJSON(VirtualMachine *vm, ObjectModule *module, const cJSON *js
     assert(false && "Invalid JSON");
 }
 
+Object *ObjectFromBytecode(VirtualMachine *vm, ObjectModule *module, BytecodeType type, BytecodeReader *reader) {
+    switch (type) {
+        case BytecodeType_String:
+            return (Object *) ObjectStringFromBytecode(vm, reader);
+        case BytecodeType_Function:
+            return (Object *) ObjectFunctionFromBytecode(vm, module, reader);
+        case BytecodeType_Class:
+            return (Object *) ObjectClassFromBytecode(vm, module, reader);
+        default:
+            reader->failed = true;
+            return NULL;
+    }
+}
+
 ObjectType ObjectGetType(const Object *self) {
     return self->type;
 }
@@ -131,6 +149,19 @@ void ObjectFree(Object *self, VirtualMachine *vm) {
 void ObjectMark(Object *self, MemoryManager *memory) {
     assert(self != NULL);
 
+#ifdef PARALLEL_MARK_SUPPORTED
+    // Another marking thread may reach the object at the same time, only one of them claims it.
+    if (memory->marker.draining) {
+        if (__atomic_load_n(&self->marked, __ATOMIC_RELAXED) ||
+            __atomic_exchange_n(&self->marked, true, __ATOMIC_RELAXED)) {
+            return;
+        }
+
+        MemoryManagerPushGray(memory, self);
+        return;
+    }
+#endif
+
     if (self->marked) {
         return;
     }
@@ -142,21 +173,7 @@ void ObjectMark(Object *self, MemoryManager *memory) {
 #endif
 
     self->marked = true;
-
-    // Not really cool if Object is responsible for adding
-    // itself to the working list of the Memory.
-
-    if (memory->gray_stack_count + 1 > memory->gray_stack_capacity) {
-        memory->gray_stack_capacity = GROW_CAPACITY(memory->gray_stack_capacity);
-        memory->gray_stack = (Object **) realloc(memory->gray_stack, sizeof(Object *) * memory->gray_stack_capacity);
-
-        if (memory->gray_stack == NULL) {
-            fprintf(stderr, "FATAL ERROR: out of memory\n");
-            exit(1);
-        }
-    }
-
-    memory->gray_stack[memory->gray_stack_count++] = self;
+    MemoryManagerPushGray(memory, self);
 }
 
 void ObjectMarkMaybeNull(Object *self, MemoryManager *memory) {
@@ -179,3 +196,75 @@ void ObjectMarkTraverse(Object *self, MemoryManager *memory) {
 #undef OBJECT_MARK_TRAVERSE
     }
 }
+
+size_t ObjectSize(const Object *self) {
+    switch (ObjectGetType(self)) {
+#define OBJECT_SIZE(name) \
+                case ObjectType_##name: \
+                    return sizeof(Object##name);
+
+        ObjectType_LIST(OBJECT_SIZE)
+
+#undef OBJECT_SIZE
+    }
+
+    assert(false && "Unknown object type");
+    return 0;
+}
+
+// Every object type has at least one field after the header, the new address takes its place.
+typedef struct ObjectMoved {
+    Object obj;
+    Object *to;
+} ObjectMoved;
+
+Object *ObjectMoveTo(Object *self, void *cell) {
+    Object *copy = cell;
+    memcpy(copy, self, ObjectSize(self));
+
+    // A closed upvalue points into itself.
+    if (ObjectIsUpvalue(self)) {
+        ObjectUpvalue *upvalue = ObjectAsUpvalue(self);
+        if (upvalue->location == &upvalue->closed) {
+            ObjectUpvalue *moved = ObjectAsUpvalue(copy);
+            moved->location = &moved->closed;
+        }
+    }
+
+    self->moved = true;
+    ((ObjectMoved *) self)->to = copy;
+    return copy;
+}
+
+Object *ObjectRelocate(Object *self, MemoryManager *memory) {
+    assert(self != NULL);
+
+    if (self->moved) {
+        return ((ObjectMoved *) self)->to;
+    }
+
+    if (self->gray) {
+        return self;
+    }
+
+    return MemoryManagerEvacuate(memory, self);
+}
+
+Object *ObjectRelocateMaybeNull(Object *self, MemoryManager *memory) {
+    return self != NULL ? ObjectRelocate(self, memory) : NULL;
+}
+
+void ObjectRelocateTraverse(Object *self, MemoryManager *memory) {
+    assert(self != NULL);
+
+    switch (ObjectGetType(self)) {
+#define OBJECT_RELOCATE_TRAVERSE(name) \
+                case ObjectType_##name: \
+                    Object##name##RelocateTraverse(ObjectAs##name(self), memory); \
+                    break;
+
+        ObjectType_LIST(OBJECT_RELOCATE_TRAVERSE)
+
+#undef OBJECT_RELOCATE_TRAVERSE
+    }
+}
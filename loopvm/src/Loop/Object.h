@@ -3,10 +3,14 @@
 
 #include "Common.h"
 
+#include "Bytecode.h"
 #include "ObjectType.h"
 
 typedef struct Object {
-    bool marked;
+    bool marked; // With GC_GENERATIONAL marks stay set between collections, marked objects are old.
+    bool remembered; // Old object in the remembered set.
+    bool gray; // Marked and on the gray stack, not traversed yet. While compacting, reached already.
+    bool moved; // Left behind by a compaction, the new address follows the header.
     ObjectType type;
     Object *next;
 } Object;
@@ -27,6 +31,9 @@ void ObjectFreeRaw(VirtualMachine *vm, Object *obj, size_t size);
 /// Use this function with caution. module_path will be set to NULL.
 Object *ObjectFromJSON(VirtualMachine *vm, ObjectModule *module, const cJSON *json);
 
+/// Returns NULL and fails the reader on an unknown type.
+Object *ObjectFromBytecode(VirtualMachine *vm, ObjectModule *module, BytecodeType type, BytecodeReader *reader);
+
 ObjectType ObjectGetType(const Object *self);
 
 #define OBJECT_IS_DECL(name) \
@@ -61,4 +68,19 @@ void ObjectMarkMaybeNull(Object *self, MemoryManager *memory);
 
 void ObjectMarkTraverse(Object *self, MemoryManager *memory);
 
+/// Size of the struct of the type, the one the object was allocated with.
+size_t ObjectSize(const Object *self);
+
+/// Copies the object into cell and leaves the new address behind. Returns the copy.
+Object *ObjectMoveTo(Object *self, void *cell);
+
+/// Returns the new address of an object while compacting. The first time an object is reached it
+/// is moved if its slab is evacuated, and queued for ObjectRelocateTraverse.
+Object *ObjectRelocate(Object *self, MemoryManager *memory);
+
+Object *ObjectRelocateMaybeNull(Object *self, MemoryManager *memory);
+
+/// Points the fields of the object to the new addresses of the objects they refer to.
+void ObjectRelocateTraverse(Object *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECT_H
@@ -11,7 +11,8 @@
     o(BoundMethod) \
     o(Upvalue) \
     o(Closure) \
-    o(List)
+    o(List) \
+    o(Shape)
 
 typedef enum ObjectType {
 #define ObjectType_ENUM(name) ObjectType_##name,
@@ -34,3 +34,8 @@ void ObjectBoundMethodMarkTraverse(ObjectBoundMethod *self, MemoryManager *memor
     ObjectMark((Object *) self->receiver, memory);
     ObjectMark((Object *) self->method, memory);
 }
+
+void ObjectBoundMethodRelocateTraverse(ObjectBoundMethod *self, MemoryManager *memory) {
+    self->receiver = (ObjectInstance *) ObjectRelocate((Object *) self->receiver, memory);
+    self->method = (ObjectFunction *) ObjectRelocate((Object *) self->method, memory);
+}
@@ -18,4 +18,6 @@ void ObjectBoundMethodPrint(const ObjectBoundMethod *self, FILE *out);
 
 void ObjectBoundMethodMarkTraverse(ObjectBoundMethod *self, MemoryManager *memory);
 
+void ObjectBoundMethodRelocateTraverse(ObjectBoundMethod *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_BOUNDMETHOD_H
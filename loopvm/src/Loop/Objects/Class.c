@@ -41,6 +41,24 @@ ObjectClass *ObjectClassFromJSON(VirtualMachine *vm, ObjectModule *module, const
     return obj;
 }
 
+ObjectClass *ObjectClassFromBytecode(VirtualMachine *vm, ObjectModule *module, BytecodeReader *reader) {
+    assert(module != NULL);
+
+    ObjectString *name = ObjectStringFromBytecode(vm, reader);
+
+    // The super class is set at runtime.
+    ObjectClass *obj = ObjectClassNew(vm, module, name);
+
+    const uint32_t methods_count = BytecodeReadU32(reader);
+
+    for (uint32_t i = 0; i < methods_count && !reader->failed; ++i) {
+        ObjectFunction *method = ObjectFunctionFromBytecode(vm, module, reader);
+        HashTablePut(&obj->methods, vm, ValueObject((Object *) method->name), ValueObject((Object *) method));
+    }
+
+    return obj;
+}
+
 void ObjectClassFree(ObjectClass *self, VirtualMachine *vm) {
     self->name = NULL;
     HashTableDeinit(&self->methods, vm);
@@ -58,3 +76,10 @@ void ObjectClassMarkTraverse(ObjectClass *self, MemoryManager *memory) {
     ObjectMarkMaybeNull((Object *) self->super, memory);
     HashTableMark(&self->methods, memory);
 }
+
+void ObjectClassRelocateTraverse(ObjectClass *self, MemoryManager *memory) {
+    self->module = (ObjectModule *) ObjectRelocate((Object *) self->module, memory);
+    self->name = (ObjectString *) ObjectRelocate((Object *) self->name, memory);
+    self->super = (ObjectClass *) ObjectRelocateMaybeNull((Object *) self->super, memory);
+    HashTableRelocate(&self->methods, memory);
+}
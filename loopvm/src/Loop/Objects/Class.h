@@ -19,10 +19,14 @@ ObjectClass *ObjectClassNew(VirtualMachine *vm, ObjectModule *module, ObjectStri
 
 ObjectClass *ObjectClassFromJSON(VirtualMachine *vm, ObjectModule *module, const cJSON *data);
 
+ObjectClass *ObjectClassFromBytecode(VirtualMachine *vm, ObjectModule *module, BytecodeReader *reader);
+
 void ObjectClassFree(ObjectClass *self, VirtualMachine *vm);
 
 void ObjectClassPrint(const ObjectClass *self, FILE *out);
 
 void ObjectClassMarkTraverse(ObjectClass *self, MemoryManager *memory);
 
+void ObjectClassRelocateTraverse(ObjectClass *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_CLASS_H
@@ -38,3 +38,10 @@ void ObjectClosureMarkTraverse(ObjectClosure *self, MemoryManager *memory) {
         ObjectMarkMaybeNull((Object *) self->upvalues[i], memory);
     }
 }
+
+void ObjectClosureRelocateTraverse(ObjectClosure *self, MemoryManager *memory) {
+    self->function = (ObjectFunction *) ObjectRelocate((Object *) self->function, memory);
+    for (size_t i = 0; i < self->upvalue_count; i++) {
+        self->upvalues[i] = (ObjectUpvalue *) ObjectRelocateMaybeNull((Object *) self->upvalues[i], memory);
+    }
+}
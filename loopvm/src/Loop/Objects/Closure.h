@@ -19,4 +19,6 @@ void ObjectClosurePrint(const ObjectClosure *self, FILE *out);
 
 void ObjectClosureMarkTraverse(ObjectClosure *self, MemoryManager *memory);
 
+void ObjectClosureRelocateTraverse(ObjectClosure *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_CLOSURE_H
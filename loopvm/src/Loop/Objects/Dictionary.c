@@ -44,3 +44,7 @@ void ObjectDictionaryPrint(const ObjectDictionary *self, FILE *out) {
 void ObjectDictionaryMarkTraverse(ObjectDictionary *self, MemoryManager *memory) {
     HashTableMark(&self->entries, memory);
 }
+
+void ObjectDictionaryRelocateTraverse(ObjectDictionary *self, MemoryManager *memory) {
+    HashTableRelocate(&self->entries, memory);
+}
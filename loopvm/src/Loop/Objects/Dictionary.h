@@ -19,4 +19,6 @@ void ObjectDictionaryPrint(const ObjectDictionary *self, FILE *out);
 
 void ObjectDictionaryMarkTraverse(ObjectDictionary *self, MemoryManager *memory);
 
+void ObjectDictionaryRelocateTraverse(ObjectDictionary *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_DICTIONARY_H
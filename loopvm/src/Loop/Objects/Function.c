@@ -1,5 +1,6 @@
 #include "Function.h"
 
+#include "../Jit.h"
 #include "../MemoryManager.h"
 
 #include "String.h"
@@ -11,6 +12,8 @@ ObjectFunction *ObjectFunctionNew(VirtualMachine *vm, ObjectModule *module, Obje
     obj->name = name;
     obj->arity = arity;
     ChunkInit(&obj->chunk);
+    obj->jit = NULL;
+    obj->jit_counter = 0;
     return obj;
 }
 
@@ -37,11 +40,30 @@ ObjectFunction *ObjectFunctionFromJSON(VirtualMachine *vm, ObjectModule *module,
     return obj;
 }
 
+ObjectFunction *ObjectFunctionFromBytecode(VirtualMachine *vm, ObjectModule *module, BytecodeReader *reader) {
+    ObjectString *name = ObjectStringFromBytecode(vm, reader);
+    const uint32_t arity = BytecodeReadU32(reader);
+
+    ObjectFunction *obj = ObjectFunctionNew(vm, module, name, arity);
+    ChunkFromBytecode(&obj->chunk, vm, module, reader);
+
+#ifdef CHUNK_DISASM_AFTER_READING
+    if (!reader->failed) {
+        ChunkDisassemble(&obj->chunk, DEBUG_OUT, name->str);
+        fprintf(DEBUG_OUT, "\n");
+    }
+#endif
+
+    return obj;
+}
+
 void ObjectFunctionFree(ObjectFunction *self, VirtualMachine *vm) {
     self->module = NULL;
     self->name = NULL;
     self->arity = 0;
     ChunkDeinit(&self->chunk, vm);
+    JitCodeFree(self->jit);
+    self->jit = NULL;
     FREE_OBJECT(vm, self, Function);
 }
 
@@ -54,3 +76,9 @@ void ObjectFunctionMarkTraverse(ObjectFunction *self, MemoryManager *memory) {
     ObjectMark((Object *) self->name, memory);
     ChunkMarkTraverse(&self->chunk, memory);
 }
+
+void ObjectFunctionRelocateTraverse(ObjectFunction *self, MemoryManager *memory) {
+    self->module = (ObjectModule *) ObjectRelocate((Object *) self->module, memory);
+    self->name = (ObjectString *) ObjectRelocate((Object *) self->name, memory);
+    ChunkRelocateTraverse(&self->chunk, memory);
+}
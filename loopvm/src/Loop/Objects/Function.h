@@ -12,16 +12,22 @@ typedef struct ObjectFunction {
     ObjectString *name;
     size_t arity;
     Chunk chunk;
+    JitCode *jit; // NULL until the function is hot.
+    uint32_t jit_counter; // Entries counted towards JIT_THRESHOLD.
 } ObjectFunction;
 
 ObjectFunction *ObjectFunctionNew(VirtualMachine *vm, ObjectModule *module, ObjectString *name, size_t arity);
 
 ObjectFunction *ObjectFunctionFromJSON(VirtualMachine *vm, ObjectModule *module, const cJSON *data);
 
+ObjectFunction *ObjectFunctionFromBytecode(VirtualMachine *vm, ObjectModule *module, BytecodeReader *reader);
+
 void ObjectFunctionFree(ObjectFunction *self, VirtualMachine *vm);
 
 void ObjectFunctionPrint(const ObjectFunction *self, FILE *out);
 
 void ObjectFunctionMarkTraverse(ObjectFunction *self, MemoryManager *memory);
 
+void ObjectFunctionRelocateTraverse(ObjectFunction *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_FUNCTION_H
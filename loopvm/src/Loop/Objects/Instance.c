@@ -1,5 +1,8 @@
 #include "Instance.h"
 
+#include "../MemoryManager.h"
+#include "../VirtualMachine.h"
+
 #include "Class.h"
 #include "Module.h"
 #include "String.h"
@@ -8,14 +11,34 @@ ObjectInstance *ObjectInstanceNew(VirtualMachine *vm, ObjectClass *klass) {
     ObjectInstance *obj = ALLOCATE_OBJECT(vm, Instance);
 
     obj->klass = klass;
-    HashTableInit(&obj->fields);
+    obj->shape = vm->common.empty_shape;
+    obj->extra_fields = NULL;
+    obj->extra_capacity = 0;
 
     return obj;
 }
 
+void ObjectInstanceAddField(ObjectInstance *self, VirtualMachine *vm, ObjectShape *new_shape, Value value) {
+    assert(new_shape->count == self->shape->count + 1);
+
+    if (new_shape->count > INSTANCE_INLINE_FIELDS + self->extra_capacity) {
+        size_t new_capacity = GROW_CAPACITY(self->extra_capacity);
+        self->extra_fields = REALLOC_ARRAY(vm, self->extra_fields, Value, new_capacity, self->extra_capacity);
+        self->extra_capacity = new_capacity;
+    }
+
+    self->shape = new_shape;
+    *ObjectInstanceSlot(self, new_shape->count - 1) = value;
+    MemoryManagerWriteBarrier(&vm->memory_manager, (Object *) self);
+}
+
 void ObjectInstanceFree(ObjectInstance *self, VirtualMachine *vm) {
+    // The shape may be already freed there.
+    FREE_ARRAY(vm, self->extra_fields, Value, self->extra_capacity);
     self->klass = NULL;
-    HashTableDeinit(&self->fields, vm);
+    self->shape = NULL;
+    self->extra_fields = NULL;
+    self->extra_capacity = 0;
     FREE_OBJECT(vm, self, Instance);
 }
 
@@ -26,5 +49,18 @@ void ObjectInstancePrint(const ObjectInstance *self, FILE *out) {
 
 void ObjectInstanceMarkTraverse(ObjectInstance *self, MemoryManager *memory) {
     ObjectMark((Object *) self->klass, memory);
-    HashTableMark(&self->fields, memory);
+    ObjectMark((Object *) self->shape, memory);
+
+    for (size_t i = 0; i < self->shape->count; ++i) {
+        ValueMark(*ObjectInstanceSlot(self, i), memory);
+    }
+}
+
+void ObjectInstanceRelocateTraverse(ObjectInstance *self, MemoryManager *memory) {
+    self->klass = (ObjectClass *) ObjectRelocate((Object *) self->klass, memory);
+    self->shape = (ObjectShape *) ObjectRelocate((Object *) self->shape, memory);
+
+    for (size_t i = 0; i < self->shape->count; ++i) {
+        ValueRelocate(ObjectInstanceSlot(self, i), memory);
+    }
 }
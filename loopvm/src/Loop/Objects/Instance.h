@@ -4,20 +4,35 @@
 #include "../Common.h"
 #include "../Object.h"
 
-#include "../HashTable.h"
+#include "../Value.h"
+#include "Shape.h"
 
 typedef struct ObjectInstance {
     Object obj;
     ObjectClass *klass;
-    HashTable fields;
+    ObjectShape *shape;
+    Value inline_fields[INSTANCE_INLINE_FIELDS];
+    Value *extra_fields; // Slots after the inline ones.
+    size_t extra_capacity;
 } ObjectInstance;
 
 ObjectInstance *ObjectInstanceNew(VirtualMachine *vm, ObjectClass *klass);
 
+/// new_shape must be a transition from the current shape.
+void ObjectInstanceAddField(ObjectInstance *self, VirtualMachine *vm, ObjectShape *new_shape, Value value);
+
+static inline Value *ObjectInstanceSlot(ObjectInstance *self, size_t index) {
+    return index < INSTANCE_INLINE_FIELDS
+           ? &self->inline_fields[index]
+           : &self->extra_fields[index - INSTANCE_INLINE_FIELDS];
+}
+
 void ObjectInstanceFree(ObjectInstance *self, VirtualMachine *vm);
 
 void ObjectInstancePrint(const ObjectInstance *self, FILE *out);
 
 void ObjectInstanceMarkTraverse(ObjectInstance *self, MemoryManager *memory);
 
+void ObjectInstanceRelocateTraverse(ObjectInstance *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_INSTANCE_H
@@ -28,6 +28,7 @@ void ObjectListPush(ObjectList *self, VirtualMachine *vm, Value value) {
     }
 
     self->elements[self->count++] = value;
+    MemoryManagerWriteBarrier(&vm->memory_manager, (Object *) self);
 }
 
 void ObjectListPrint(const ObjectList *self, FILE *out) {
@@ -47,3 +48,9 @@ void ObjectListMarkTraverse(ObjectList *self, MemoryManager *memory) {
         ValueMark(self->elements[i], memory);
     }
 }
+
+void ObjectListRelocateTraverse(ObjectList *self, MemoryManager *memory) {
+    for (size_t i = 0; i < self->count; i++) {
+        ValueRelocate(&self->elements[i], memory);
+    }
+}
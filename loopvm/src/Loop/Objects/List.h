@@ -21,4 +21,6 @@ void ObjectListPrint(const ObjectList *self, FILE *out);
 
 void ObjectListMarkTraverse(ObjectList *self, MemoryManager *memory);
 
+void ObjectListRelocateTraverse(ObjectList *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_LIST_H
@@ -24,6 +24,8 @@ ObjectModule *ObjectModuleNew(VirtualMachine *vm, ObjectString *name, ObjectStri
         obj->globals[i] = ValueNull();
     }
     obj->state = ObjectModuleState_ScriptNotExecuted;
+    obj->code_map = NULL;
+    obj->code_map_size = 0;
 
     return obj;
 }
@@ -41,7 +43,7 @@ ObjectModule *ObjectModuleFromJSON(VirtualMachine *vm, ObjectString *path, const
     const cJSON *chunk_json = cJSON_GetObjectItemCaseSensitive(data, "chunk");
 
     ObjectModule *module = ObjectModuleNew(vm, name, parent_dir, globals_count);
-    bool put_res = HashTablePut(&vm->modules, vm, ValueObject((Object *) module->name), ValueObject((Object *) module));
+    bool put_res = HashTablePut(&vm->modules, vm, ValueObject((Object *) path), ValueObject((Object *) module));
     assert(put_res);
 
     ChunkFromJSON(&module->script->chunk, vm, module, chunk_json);
@@ -53,7 +55,53 @@ ObjectModule *ObjectModuleFromJSON(VirtualMachine *vm, ObjectString *path, const
     return module;
 }
 
+Error ObjectModuleFromBytecode(VirtualMachine *vm, ObjectString *path, const uint8_t *data, size_t size,
+                               ObjectModule **ptr) {
+    BytecodeReader reader;
+    BytecodeReaderInit(&reader, data, size);
+
+    BytecodeReadBytes(&reader, BYTECODE_MAGIC_LENGTH);
+    const uint32_t version = BytecodeReadU32(&reader);
+
+    if (version != BYTECODE_VERSION) {
+        fprintf(USER_ERR, "error: '%s' has bytecode version %u, expected %u. Recompile it.\n",
+                path->str, version, BYTECODE_VERSION);
+        UnmapFile(data, size);
+        return Error_InvalidBytecode;
+    }
+
+    ObjectString *name = RemoveExtension(vm, GetBaseName(vm, path));
+    ObjectString *parent_dir = GetDirName(vm, GetDirName(vm, path));
+
+    const size_t globals_count = BytecodeReadU32(&reader);
+
+    ObjectModule *module = ObjectModuleNew(vm, name, parent_dir, globals_count);
+    module->code_map = data;
+    module->code_map_size = size;
+
+    // Imports look modules up by the absolute path of the compiled file.
+    bool put_res = HashTablePut(&vm->modules, vm, ValueObject((Object *) path), ValueObject((Object *) module));
+    assert(put_res);
+
+    ChunkFromBytecode(&module->script->chunk, vm, module, &reader);
+
+    if (reader.failed) {
+        fprintf(USER_ERR, "error: invalid bytecode in '%s'.\n", path->str);
+        return Error_InvalidBytecode;
+    }
+
+#ifdef CHUNK_DISASM_AFTER_READING
+    ChunkDisassemble(&module->script->chunk, DEBUG_OUT, module->script->name->str);
+#endif
+
+    *ptr = module;
+    return Error_None;
+}
+
 void ObjectModuleFree(ObjectModule *self, VirtualMachine *vm) {
+    UnmapFile(self->code_map, self->code_map_size);
+    self->code_map = NULL;
+    self->code_map_size = 0;
     self->name = NULL;
     self->parent_dir = NULL;
     self->script = NULL;
@@ -77,3 +125,13 @@ void ObjectModuleMarkTraverse(ObjectModule *self, MemoryManager *memory) {
         ValueMark(self->globals[i], memory);
     }
 }
+
+void ObjectModuleRelocateTraverse(ObjectModule *self, MemoryManager *memory) {
+    self->name = (ObjectString *) ObjectRelocate((Object *) self->name, memory);
+    self->parent_dir = (ObjectString *) ObjectRelocate((Object *) self->parent_dir, memory);
+    self->script = (ObjectFunction *) ObjectRelocate((Object *) self->script, memory);
+    HashTableRelocate(&self->exports, memory);
+    for (size_t i = 0; i < self->globals_count; ++i) {
+        ValueRelocate(&self->globals[i], memory);
+    }
+}
@@ -21,6 +21,8 @@ typedef struct ObjectModule {
     Value *globals;
     HashTable exports;
     ObjectModuleState state;
+    const uint8_t *code_map; // Mapped binary .code file, NULL for JSON modules.
+    size_t code_map_size;
 } ObjectModule;
 
 ObjectModule *ObjectModuleNew(VirtualMachine *vm, ObjectString *name, ObjectString *parent_dir, size_t globals_count);
@@ -28,10 +30,16 @@ ObjectModule *ObjectModuleNew(VirtualMachine *vm, ObjectString *name, ObjectStri
 /// module can be NULL.
 ObjectModule *ObjectModuleFromJSON(VirtualMachine *vm, ObjectString *path, const cJSON *data);
 
+/// Takes ownership of the mapped file, the module unmaps it when it is freed.
+Error ObjectModuleFromBytecode(VirtualMachine *vm, ObjectString *path, const uint8_t *data, size_t size,
+                               ObjectModule **ptr);
+
 void ObjectModuleFree(ObjectModule *self, VirtualMachine *vm);
 
 void ObjectModulePrint(const ObjectModule *self, FILE *out);
 
 void ObjectModuleMarkTraverse(ObjectModule *self, MemoryManager *memory);
 
+void ObjectModuleRelocateTraverse(ObjectModule *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_MODULE_H
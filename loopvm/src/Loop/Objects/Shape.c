@@ -0,0 +1,69 @@
+#include "Shape.h"
+
+#include "../MemoryManager.h"
+#include "../VirtualMachine.h"
+
+ObjectShape *ObjectShapeNew(VirtualMachine *vm) {
+    ObjectShape *obj = ALLOCATE_OBJECT(vm, Shape);
+    obj->keys = NULL;
+    obj->count = 0;
+    obj->transitions = NULL;
+    obj->sibling = NULL;
+    return obj;
+}
+
+ObjectShape *ObjectShapeTransition(ObjectShape *self, VirtualMachine *vm, Value key) {
+    for (ObjectShape *child = self->transitions; child != NULL; child = child->sibling) {
+        if (ValueAreEqual(child->keys[child->count - 1], key)) {
+            return child;
+        }
+    }
+
+    // Keys are allocated first, the new shape must not be collected before it is linked.
+    Value *keys = ALLOC_ARRAY(vm, Value, self->count + 1);
+    for (size_t i = 0; i < self->count; ++i) {
+        keys[i] = self->keys[i];
+    }
+    keys[self->count] = key;
+
+    ObjectShape *obj = ObjectShapeNew(vm);
+    obj->keys = keys;
+    obj->count = self->count + 1;
+    obj->sibling = self->transitions;
+
+    self->transitions = obj;
+    MemoryManagerWriteBarrier(&vm->memory_manager, (Object *) self);
+
+    return obj;
+}
+
+void ObjectShapeFree(ObjectShape *self, VirtualMachine *vm) {
+    FREE_ARRAY(vm, self->keys, Value, self->count);
+    self->keys = NULL;
+    self->count = 0;
+    self->transitions = NULL;
+    self->sibling = NULL;
+    FREE_OBJECT(vm, self, Shape);
+}
+
+void ObjectShapePrint(const ObjectShape *self, FILE *out) {
+    fprintf(out, "<shape of %zu fields>", self->count);
+}
+
+void ObjectShapeMarkTraverse(ObjectShape *self, MemoryManager *memory) {
+    for (size_t i = 0; i < self->count; ++i) {
+        ValueMark(self->keys[i], memory);
+    }
+
+    ObjectMarkMaybeNull((Object *) self->transitions, memory);
+    ObjectMarkMaybeNull((Object *) self->sibling, memory);
+}
+
+void ObjectShapeRelocateTraverse(ObjectShape *self, MemoryManager *memory) {
+    for (size_t i = 0; i < self->count; ++i) {
+        ValueRelocate(&self->keys[i], memory);
+    }
+
+    self->transitions = (ObjectShape *) ObjectRelocateMaybeNull((Object *) self->transitions, memory);
+    self->sibling = (ObjectShape *) ObjectRelocateMaybeNull((Object *) self->sibling, memory);
+}
@@ -0,0 +1,43 @@
+#ifndef LOOP_OBJECTS_SHAPE_H
+#define LOOP_OBJECTS_SHAPE_H
+
+#include "../Common.h"
+#include "../Object.h"
+
+#include "../Value.h"
+
+/// Layout of instance fields. Instances that got the same fields in the same order share a shape,
+/// field values are stored by slot index. Shapes form a tree rooted at common.empty_shape.
+typedef struct ObjectShape {
+    Object obj;
+    Value *keys; // Field names in slot order.
+    size_t count;
+    ObjectShape *transitions; // First shape that extends this one by one key.
+    ObjectShape *sibling; // Next transition of the same parent.
+} ObjectShape;
+
+ObjectShape *ObjectShapeNew(VirtualMachine *vm);
+
+/// Returns the slot index or -1.
+static inline int ObjectShapeFind(const ObjectShape *self, Value key) {
+    for (size_t i = 0; i < self->count; ++i) {
+        if (ValueAreEqual(self->keys[i], key)) {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+/// Returns the shape with key appended, reusing an existing transition.
+ObjectShape *ObjectShapeTransition(ObjectShape *self, VirtualMachine *vm, Value key);
+
+void ObjectShapeFree(ObjectShape *self, VirtualMachine *vm);
+
+void ObjectShapePrint(const ObjectShape *self, FILE *out);
+
+void ObjectShapeMarkTraverse(ObjectShape *self, MemoryManager *memory);
+
+void ObjectShapeRelocateTraverse(ObjectShape *self, MemoryManager *memory);
+
+#endif // LOOP_OBJECTS_SHAPE_H
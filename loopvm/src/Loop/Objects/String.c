@@ -42,6 +42,21 @@ ObjectString *ObjectStringFromJSON(VirtualMachine *vm, const cJSON *data) {
     return ObjectStringNew(vm, new_str, length, hash);
 }
 
+ObjectString *ObjectStringFromBytecode(VirtualMachine *vm, BytecodeReader *reader) {
+    const size_t length = BytecodeReadU32(reader);
+    const uint8_t *bytes = BytecodeReadBytes(reader, length);
+
+    if (bytes == NULL) {
+        return vm->common.empty_string;
+    }
+
+    char *new_str = ALLOC_ARRAY(vm, char, length + 1);
+    memcpy(new_str, bytes, length);
+    new_str[length] = '\0';
+
+    return ObjectStringNew(vm, new_str, length, CalculateStringHash(new_str, length));
+}
+
 void ObjectStringFree(ObjectString *self, VirtualMachine *vm) {
     FREE_ARRAY(vm, self->str, char, self->length + 1);
     self->hash = 0;
@@ -72,7 +87,7 @@ ObjectString *ObjectStringConcatenate(VirtualMachine *vm, const ObjectString *le
     char *str = ALLOC_ARRAY(vm, char, length + 1);
     strcpy(str, left->str);
     strcpy(str + left->length, right->str);
-    return ObjectStringNew(vm, str, length, left->hash);
+    return ObjectStringNew(vm, str, length, CalculateStringHash(str, length));
 }
 
 ObjectString *ObjectStringSubstring(VirtualMachine *vm, const ObjectString *str, size_t start, size_t end) {
@@ -96,3 +111,7 @@ ObjectString *ObjectStringSubstring(VirtualMachine *vm, const ObjectString *str,
 void ObjectStringMarkTraverse(ObjectString *self, MemoryManager *memory) {
 
 }
+
+void ObjectStringRelocateTraverse(ObjectString *self, MemoryManager *memory) {
+
+}
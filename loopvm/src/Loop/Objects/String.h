@@ -17,6 +17,8 @@ ObjectString *ObjectStringFromLiteral(VirtualMachine *vm, const char *str);
 
 ObjectString *ObjectStringFromJSON(VirtualMachine *vm, const cJSON *data);
 
+ObjectString *ObjectStringFromBytecode(VirtualMachine *vm, BytecodeReader *reader);
+
 void ObjectStringFree(ObjectString *self, VirtualMachine *vm);
 
 size_t CalculateStringHash(const char *str, size_t length);
@@ -29,4 +31,6 @@ void ObjectStringPrint(const ObjectString *self, FILE *out);
 
 void ObjectStringMarkTraverse(ObjectString *self, MemoryManager *memory);
 
+void ObjectStringRelocateTraverse(ObjectString *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_STRING_H
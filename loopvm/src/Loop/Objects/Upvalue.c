@@ -22,3 +22,8 @@ void ObjectUpvaluePrint(const ObjectUpvalue *self, FILE *out) {
 void ObjectUpvalueMarkTraverse(ObjectUpvalue *self, MemoryManager *memory) {
     ValueMark(self->closed, memory);
 }
+
+void ObjectUpvalueRelocateTraverse(ObjectUpvalue *self, MemoryManager *memory) {
+    ValueRelocate(&self->closed, memory);
+    self->next = (ObjectUpvalue *) ObjectRelocateMaybeNull((Object *) self->next, memory);
+}
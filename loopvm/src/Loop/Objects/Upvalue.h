@@ -21,4 +21,6 @@ void ObjectUpvaluePrint(const ObjectUpvalue *self, FILE *out);
 
 void ObjectUpvalueMarkTraverse(ObjectUpvalue *self, MemoryManager *memory);
 
+void ObjectUpvalueRelocateTraverse(ObjectUpvalue *self, MemoryManager *memory);
+
 #endif // LOOP_OBJECTS_UPVALUE_H
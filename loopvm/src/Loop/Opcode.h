@@ -49,7 +49,49 @@
     o(SuperGet, Constant)     \
     o(TryBegin, Jump)  \
     o(TryEnd, Simple)  \
-    o(Throw, Simple)
+    o(Throw, Simple) \
+    o(InstanceOf, Simple) \
+    o(Invoke, Invoke) \
+    o(Wide, Wide) \
+    o(LessEqual, Simple) \
+    o(GreaterEqual, Simple) \
+    o(NotEqual, Simple) \
+    o(SetLocalPop, Byte) \
+    o(SetGlobalPop, Byte) \
+    o(AddLocalLocal, LocalLocal) \
+    o(IncrementLocal, LocalConstant) \
+    o(LessJumpIfFalse, Jump) \
+    o(LessLocalConstJumpIfFalse, JumpLocalConstant)
+
+// Opcodes that may follow the Wide prefix and the size of their first operand after it:
+// two bytes instead of one for indices and four instead of two for jump offsets.
+#define Opcode_WIDE_LIST(o) \
+    o(PushConstant, SHORT) \
+    o(GetGlobal, SHORT) \
+    o(SetGlobal, SHORT) \
+    o(GetLocal, SHORT) \
+    o(SetLocal, SHORT) \
+    o(Export, SHORT) \
+    o(Import, SHORT) \
+    o(GetAttribute, SHORT) \
+    o(SetAttribute, SHORT) \
+    o(GetExport, SHORT) \
+    o(SetExport, SHORT) \
+    o(SuperGet, SHORT) \
+    o(Invoke, SHORT) \
+    o(SetLocalPop, SHORT) \
+    o(SetGlobalPop, SHORT) \
+    o(JumpIfFalse, LONG) \
+    o(JumpIfTrue, LONG) \
+    o(JumpIfFalsePop, LONG) \
+    o(Jump, LONG) \
+    o(Loop, LONG) \
+    o(TryBegin, LONG) \
+    o(LessJumpIfFalse, LONG) \
+    o(LessLocalConstJumpIfFalse, LONG)
+
+#define Opcode_WIDE_SHORT 2
+#define Opcode_WIDE_LONG 4
 
 typedef enum Opcode {
 #define Opcode_ENUM(name, _) Opcode_##name,
@@ -57,6 +99,8 @@ typedef enum Opcode {
     Opcode_LIST(Opcode_ENUM)
 
 #undef Opcode_ENUM
+
+    Opcode_COUNT, // Not an opcode.
 } Opcode;
 
 const char *OpcodeToString(Opcode value);
@@ -0,0 +1,159 @@
+#include "OpcodeProfile.h"
+
+typedef struct OpcodePair {
+    Opcode first;
+    Opcode second;
+    uint64_t count;
+} OpcodePair;
+
+static uint64_t OpcodeProfileTotal(const OpcodeProfile *self);
+
+static size_t SortedOpcodes(const OpcodeProfile *self, Opcode *opcodes);
+
+static size_t SortedPairs(const OpcodeProfile *self, OpcodePair *pairs);
+
+static void WriteText(const OpcodeProfile *self, FILE *out);
+
+static void WriteJSON(const OpcodeProfile *self, FILE *out);
+
+void OpcodeProfileInit(OpcodeProfile *self) {
+    memset(self, 0, sizeof(*self));
+    self->has_previous = false;
+}
+
+void OpcodeProfileWrite(const OpcodeProfile *self, FILE *out, OpcodeProfileFormat format) {
+    switch (format) {
+        case OpcodeProfileFormat_Text:
+            WriteText(self, out);
+            break;
+        case OpcodeProfileFormat_JSON:
+            WriteJSON(self, out);
+            break;
+    }
+}
+
+static uint64_t OpcodeProfileTotal(const OpcodeProfile *self) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < Opcode_COUNT; ++i) {
+        total += self->counts[i];
+    }
+    return total;
+}
+
+// qsort has no context argument.
+static const OpcodeProfile *sorted_profile;
+
+static int CompareOpcodes(const void *a, const void *b) {
+    const uint64_t lhs = sorted_profile->counts[*(const Opcode *) a];
+    const uint64_t rhs = sorted_profile->counts[*(const Opcode *) b];
+    return lhs < rhs ? 1 : lhs > rhs ? -1 : 0;
+}
+
+static int ComparePairs(const void *a, const void *b) {
+    const uint64_t lhs = ((const OpcodePair *) a)->count;
+    const uint64_t rhs = ((const OpcodePair *) b)->count;
+    return lhs < rhs ? 1 : lhs > rhs ? -1 : 0;
+}
+
+static size_t SortedOpcodes(const OpcodeProfile *self, Opcode *opcodes) {
+    size_t length = 0;
+    for (size_t i = 0; i < Opcode_COUNT; ++i) {
+        if (self->counts[i] != 0) {
+            opcodes[length++] = (Opcode) i;
+        }
+    }
+
+    sorted_profile = self;
+    qsort(opcodes, length, sizeof(Opcode), CompareOpcodes);
+    sorted_profile = NULL;
+
+    return length;
+}
+
+static size_t SortedPairs(const OpcodeProfile *self, OpcodePair *pairs) {
+    size_t length = 0;
+    for (size_t i = 0; i < Opcode_COUNT; ++i) {
+        for (size_t j = 0; j < Opcode_COUNT; ++j) {
+            if (self->pairs[i][j] != 0) {
+                pairs[length++] = (OpcodePair) {(Opcode) i, (Opcode) j, self->pairs[i][j]};
+            }
+        }
+    }
+
+    qsort(pairs, length, sizeof(OpcodePair), ComparePairs);
+
+    return length;
+}
+
+static void WriteText(const OpcodeProfile *self, FILE *out) {
+    const double total = (double) OpcodeProfileTotal(self);
+
+    Opcode opcodes[Opcode_COUNT];
+    const size_t opcodes_length = SortedOpcodes(self, opcodes);
+
+    fprintf(out, "%-28s %14s %7s %16s %10s\n", "opcode", "count", "%", "cycles", "cycles/op");
+    for (size_t i = 0; i < opcodes_length; ++i) {
+        const Opcode opcode = opcodes[i];
+        fprintf(out, "%-28s %14llu %6.2f%% %16llu %10.1f\n", OpcodeToString(opcode),
+                (unsigned long long) self->counts[opcode], 100.0 * (double) self->counts[opcode] / total,
+                (unsigned long long) self->cycles[opcode],
+                (double) self->cycles[opcode] / (double) self->counts[opcode]);
+    }
+
+    OpcodePair *pairs = malloc(sizeof(OpcodePair) * Opcode_COUNT * Opcode_COUNT);
+    if (pairs == NULL) {
+        return;
+    }
+
+    const size_t pairs_length = SortedPairs(self, pairs);
+
+    fprintf(out, "\n%-57s %14s %7s\n", "pair", "count", "%");
+    for (size_t i = 0; i < pairs_length && i < OPCODE_PROFILE_TEXT_PAIRS; ++i) {
+        fprintf(out, "%-28s %-28s %14llu %6.2f%%\n", OpcodeToString(pairs[i].first),
+                OpcodeToString(pairs[i].second), (unsigned long long) pairs[i].count,
+                100.0 * (double) pairs[i].count / total);
+    }
+
+    free(pairs);
+}
+
+static void WriteJSON(const OpcodeProfile *self, FILE *out) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "total", (double) OpcodeProfileTotal(self));
+
+    Opcode opcodes[Opcode_COUNT];
+    const size_t opcodes_length = SortedOpcodes(self, opcodes);
+
+    cJSON *opcodes_json = cJSON_AddArrayToObject(json, "opcodes");
+    for (size_t i = 0; i < opcodes_length; ++i) {
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", OpcodeToString(opcodes[i]));
+        cJSON_AddNumberToObject(item, "count", (double) self->counts[opcodes[i]]);
+        cJSON_AddNumberToObject(item, "cycles", (double) self->cycles[opcodes[i]]);
+        cJSON_AddItemToArray(opcodes_json, item);
+    }
+
+    OpcodePair *pairs = malloc(sizeof(OpcodePair) * Opcode_COUNT * Opcode_COUNT);
+    if (pairs != NULL) {
+        const size_t pairs_length = SortedPairs(self, pairs);
+
+        cJSON *pairs_json = cJSON_AddArrayToObject(json, "pairs");
+        for (size_t i = 0; i < pairs_length; ++i) {
+            cJSON *item = cJSON_CreateObject();
+            cJSON_AddStringToObject(item, "first", OpcodeToString(pairs[i].first));
+            cJSON_AddStringToObject(item, "second", OpcodeToString(pairs[i].second));
+            cJSON_AddNumberToObject(item, "count", (double) pairs[i].count);
+            cJSON_AddItemToArray(pairs_json, item);
+        }
+
+        free(pairs);
+    }
+
+    char *text = cJSON_Print(json);
+    if (text != NULL) {
+        fprintf(out, "%s\n", text);
+        cJSON_free(text);
+    }
+
+    cJSON_Delete(json);
+}
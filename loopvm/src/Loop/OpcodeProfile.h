@@ -0,0 +1,66 @@
+#ifndef LOOP_OPCODEPROFILE_H
+#define LOOP_OPCODEPROFILE_H
+
+#include "Common.h"
+#include "Opcode.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/// Executed opcodes and adjacent opcode pairs, collected with loopvm --profile-opcodes.
+/// The time stamp counter is read at every dispatch and the difference is charged to the
+/// previous opcode, so its cycles include everything the handler did and the dispatch itself.
+typedef struct OpcodeProfile {
+    uint64_t counts[Opcode_COUNT];
+    uint64_t cycles[Opcode_COUNT];
+    uint64_t pairs[Opcode_COUNT][Opcode_COUNT];
+    Opcode previous;
+    bool has_previous;
+    uint64_t previous_time;
+} OpcodeProfile;
+
+typedef enum OpcodeProfileFormat {
+    OpcodeProfileFormat_Text,
+    OpcodeProfileFormat_JSON,
+} OpcodeProfileFormat;
+
+void OpcodeProfileInit(OpcodeProfile *self);
+
+/// Cycles on x86, nanoseconds elsewhere.
+static inline uint64_t OpcodeProfileTime(void) {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}
+
+static inline void OpcodeProfileRecord(OpcodeProfile *self, uint8_t opcode) {
+    if (opcode >= Opcode_COUNT) {
+        return;
+    }
+
+    const uint64_t now = OpcodeProfileTime();
+
+    if (self->has_previous) {
+        self->cycles[self->previous] += now - self->previous_time;
+        self->pairs[self->previous][opcode]++;
+    }
+
+    self->counts[opcode]++;
+    self->previous = opcode;
+    self->has_previous = true;
+    self->previous_time = now;
+}
+
+/// Opcodes and pairs sorted by their counts. The text report lists only the most common pairs.
+void OpcodeProfileWrite(const OpcodeProfile *self, FILE *out, OpcodeProfileFormat format);
+
+#endif // LOOP_OPCODEPROFILE_H
@@ -0,0 +1,397 @@
+#include "ParallelMarker.h"
+
+#ifdef PARALLEL_MARK_SUPPORTED
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "MemoryManager.h"
+#include "Object.h"
+
+static size_t DefaultThreadsCount(void) {
+#ifdef GC_STRESS
+    return GC_STRESS_MARK_THREADS;
+#elif defined(PARALLEL_MARK_SUPPORTED)
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        return 1;
+    }
+
+    return cpus < GC_MAX_MARK_THREADS ? (size_t) cpus : GC_MAX_MARK_THREADS;
+#else
+    return 1;
+#endif
+}
+
+#ifndef PARALLEL_MARK_SUPPORTED
+
+void ParallelMarkerInit(ParallelMarker *self, MemoryManager *memory) {
+    (void) memory;
+    self->threads_count = DefaultThreadsCount();
+}
+
+void ParallelMarkerDeinit(ParallelMarker *self) {
+    (void) self;
+}
+
+#else
+
+// The worker of the calling thread while it drains, ObjectMark has no other way to find it.
+static _Thread_local MarkWorker *current_worker = NULL;
+
+void ParallelMarkerInit(ParallelMarker *self, MemoryManager *memory) {
+    self->memory = memory;
+    self->threads_count = DefaultThreadsCount();
+    self->workers = NULL;
+    self->draining = false;
+    self->deadline = 0;
+    self->round = 0;
+    self->finished = 0;
+    self->quit = false;
+    atomic_init(&self->idle, 0);
+    atomic_init(&self->stop, false);
+}
+
+void ParallelMarkerDeinit(ParallelMarker *self) {
+    if (self->workers == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    self->quit = true;
+    pthread_cond_broadcast(&self->wake);
+    pthread_mutex_unlock(&self->lock);
+
+    for (size_t i = 0; i < self->threads_count; ++i) {
+        MarkWorker *worker = &self->workers[i];
+
+        if (i != 0) {
+            pthread_join(worker->thread, NULL);
+        }
+
+        pthread_mutex_destroy(&worker->lock);
+        free(worker->items);
+    }
+
+    pthread_mutex_destroy(&self->lock);
+    pthread_cond_destroy(&self->wake);
+    pthread_cond_destroy(&self->done);
+    free(self->workers);
+    self->workers = NULL;
+}
+
+// Makes room for one more item, compacting away what was stolen from the top first.
+static void WorkerReserve(MarkWorker *self) {
+    pthread_mutex_lock(&self->lock);
+
+    if (self->top > 0) {
+        memmove(self->items, self->items + self->top, sizeof(Object *) * (self->bottom - self->top));
+        self->split -= self->top;
+        self->bottom -= self->top;
+        self->top = 0;
+    }
+
+    if (self->bottom == self->capacity) {
+        self->capacity = GROW_CAPACITY(self->capacity);
+        self->items = (Object **) realloc(self->items, sizeof(Object *) * self->capacity);
+
+        if (self->items == NULL) {
+            fprintf(stderr, "FATAL ERROR: out of memory\n");
+            exit(1);
+        }
+    }
+
+    pthread_mutex_unlock(&self->lock);
+}
+
+static inline void WorkerPush(MarkWorker *self, Object *object) {
+    if (self->bottom == self->capacity) {
+        WorkerReserve(self);
+    }
+
+    self->items[self->bottom++] = object;
+}
+
+static inline Object *WorkerPop(MarkWorker *self) {
+    return self->bottom > self->split ? self->items[--self->bottom] : NULL;
+}
+
+static void WorkerShare(MarkWorker *self) {
+    pthread_mutex_lock(&self->lock);
+    self->split += (self->bottom - self->split) / 2;
+    atomic_store_explicit(&self->shared, self->split - self->top, memory_order_relaxed);
+    pthread_mutex_unlock(&self->lock);
+}
+
+// Takes back what nobody has stolen once the private part is empty.
+static bool WorkerReclaim(MarkWorker *self) {
+    pthread_mutex_lock(&self->lock);
+
+    const bool found = self->split > self->top;
+    self->split = self->top;
+    if (!found) {
+        self->top = 0;
+        self->split = 0;
+        self->bottom = 0;
+    }
+
+    atomic_store_explicit(&self->shared, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&self->lock);
+    return found;
+}
+
+// The batch is copied out first, so a worker never holds two locks.
+static bool WorkerSteal(MarkWorker *self, MarkWorker *victim) {
+    Object *batch[GC_MARK_STEAL_BATCH];
+
+    pthread_mutex_lock(&victim->lock);
+
+    size_t count = (victim->split - victim->top + 1) / 2;
+    if (count > GC_MARK_STEAL_BATCH) {
+        count = GC_MARK_STEAL_BATCH;
+    }
+
+    memcpy(batch, victim->items + victim->top, sizeof(Object *) * count);
+    victim->top += count;
+    atomic_store_explicit(&victim->shared, victim->split - victim->top, memory_order_relaxed);
+
+    pthread_mutex_unlock(&victim->lock);
+
+    for (size_t i = 0; i < count; ++i) {
+        WorkerPush(self, batch[i]);
+    }
+
+    return count > 0;
+}
+
+static bool WorkerFindWork(MarkWorker *self) {
+    if (WorkerReclaim(self)) {
+        return true;
+    }
+
+    const ParallelMarker *marker = self->marker;
+
+    for (size_t i = 1; i < marker->threads_count; ++i) {
+        MarkWorker *victim = &marker->workers[(self->index + i) % marker->threads_count];
+
+        if (atomic_load_explicit(&victim->shared, memory_order_relaxed) > 0 && WorkerSteal(self, victim)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool AnyShared(const ParallelMarker *self) {
+    for (size_t i = 0; i < self->threads_count; ++i) {
+        if (atomic_load_explicit(&self->workers[i].shared, memory_order_relaxed) > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Returns false once the drain is over. A worker only becomes idle with its own deque empty and
+// only busy workers share, so when all of them are idle no gray object is left.
+static bool WorkerWait(MarkWorker *self) {
+    ParallelMarker *marker = self->marker;
+
+    atomic_fetch_add(&marker->idle, 1);
+
+    for (;;) {
+        if (atomic_load(&marker->stop)) {
+            return false;
+        }
+
+        if (atomic_load(&marker->idle) == marker->threads_count) {
+            atomic_store(&marker->stop, true);
+            return false;
+        }
+
+        if (AnyShared(marker)) {
+            atomic_fetch_sub(&marker->idle, 1);
+
+            if (WorkerFindWork(self)) {
+                return true;
+            }
+
+            atomic_fetch_add(&marker->idle, 1);
+        }
+
+        sched_yield();
+    }
+}
+
+// Stops with objects left in the deque when the deadline passes.
+static void WorkerRun(MarkWorker *self) {
+    ParallelMarker *marker = self->marker;
+    size_t traversed = 0;
+
+    do {
+        Object *object;
+
+        while ((object = WorkerPop(self)) != NULL) {
+            object->gray = false;
+            ObjectMarkTraverse(object, marker->memory);
+
+            if (++traversed % GC_MARK_CLOCK_INTERVAL == 0) {
+                if (atomic_load_explicit(&marker->stop, memory_order_relaxed)) {
+                    return;
+                }
+
+                if (marker->deadline != UINT64_MAX && MemoryManagerNowNanoseconds() >= marker->deadline) {
+                    atomic_store(&marker->stop, true);
+                    return;
+                }
+            }
+
+            if (self->bottom - self->split > 1 &&
+                atomic_load_explicit(&self->shared, memory_order_relaxed) == 0 &&
+                atomic_load_explicit(&marker->idle, memory_order_relaxed) > 0) {
+                WorkerShare(self);
+            }
+        }
+    } while (WorkerFindWork(self) || WorkerWait(self));
+}
+
+static void *HelperMain(void *argument) {
+    MarkWorker *self = argument;
+    ParallelMarker *marker = self->marker;
+
+    current_worker = self;
+
+    for (;;) {
+        pthread_mutex_lock(&marker->lock);
+        while (!marker->quit && marker->round == self->round) {
+            pthread_cond_wait(&marker->wake, &marker->lock);
+        }
+
+        if (marker->quit) {
+            pthread_mutex_unlock(&marker->lock);
+            return NULL;
+        }
+
+        self->round = marker->round;
+        pthread_mutex_unlock(&marker->lock);
+
+        WorkerRun(self);
+
+        pthread_mutex_lock(&marker->lock);
+        if (++marker->finished == marker->threads_count - 1) {
+            pthread_cond_signal(&marker->done);
+        }
+        pthread_mutex_unlock(&marker->lock);
+    }
+}
+
+static void WorkerInit(MarkWorker *self, ParallelMarker *marker, size_t index) {
+    self->marker = marker;
+    self->index = index;
+    self->items = NULL;
+    self->capacity = 0;
+    self->top = 0;
+    self->split = 0;
+    self->bottom = 0;
+    atomic_init(&self->shared, 0);
+    self->round = marker->round;
+    pthread_mutex_init(&self->lock, NULL);
+}
+
+// Marks on fewer threads if some cannot be created.
+static void StartHelpers(ParallelMarker *self) {
+    self->workers = malloc(sizeof(MarkWorker) * self->threads_count);
+    if (self->workers == NULL) {
+        fprintf(stderr, "FATAL ERROR: out of memory\n");
+        exit(1);
+    }
+
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->wake, NULL);
+    pthread_cond_init(&self->done, NULL);
+
+    // Signals, SIGPROF of the sampler among them, go to the thread that runs the program.
+    sigset_t all;
+    sigset_t previous;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+
+    WorkerInit(&self->workers[0], self, 0);
+
+    size_t started = 1;
+    while (started < self->threads_count) {
+        MarkWorker *worker = &self->workers[started];
+        WorkerInit(worker, self, started);
+
+        if (pthread_create(&worker->thread, NULL, HelperMain, worker) != 0) {
+            pthread_mutex_destroy(&worker->lock);
+            break;
+        }
+
+        ++started;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    self->threads_count = started;
+}
+
+void ParallelMarkerDrain(ParallelMarker *self, uint64_t deadline) {
+    MemoryManager *memory = self->memory;
+
+    if (self->workers == NULL) {
+        StartHelpers(self);
+    }
+
+    // The gray stack becomes the private part of the collecting thread's deque.
+    MarkWorker *main = &self->workers[0];
+    Object **items = main->items;
+    const size_t capacity = main->capacity;
+    main->items = memory->gray_stack;
+    main->capacity = memory->gray_stack_capacity;
+    main->bottom = memory->gray_stack_count;
+    memory->gray_stack = items;
+    memory->gray_stack_capacity = capacity;
+    memory->gray_stack_count = 0;
+
+    pthread_mutex_lock(&self->lock);
+    self->draining = true;
+    self->deadline = deadline;
+    self->finished = 0;
+    atomic_store(&self->idle, 0);
+    atomic_store(&self->stop, false);
+    ++self->round;
+    pthread_cond_broadcast(&self->wake);
+    pthread_mutex_unlock(&self->lock);
+
+    current_worker = main;
+    WorkerRun(main);
+    current_worker = NULL;
+
+    pthread_mutex_lock(&self->lock);
+    while (self->finished < self->threads_count - 1) {
+        pthread_cond_wait(&self->done, &self->lock);
+    }
+    self->draining = false;
+    pthread_mutex_unlock(&self->lock);
+
+    for (size_t i = 0; i < self->threads_count; ++i) {
+        MarkWorker *worker = &self->workers[i];
+
+        for (size_t j = worker->top; j < worker->bottom; ++j) {
+            MemoryManagerPushGray(memory, worker->items[j]);
+        }
+
+        worker->top = 0;
+        worker->split = 0;
+        worker->bottom = 0;
+        atomic_store_explicit(&worker->shared, 0, memory_order_relaxed);
+    }
+}
+
+void ParallelMarkerPush(ParallelMarker *self, Object *object) {
+    (void) self;
+    WorkerPush(current_worker, object);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef LOOP_PARALLELMARKER_H
+#define LOOP_PARALLELMARKER_H
+
+#include "Common.h"
+
+// GC_PARALLEL is set from CMake (LOOP_PARALLEL_GC). The helper threads are POSIX threads,
+// elsewhere one thread marks.
+#if defined(GC_PARALLEL) && (defined(__unix__) || defined(__APPLE__))
+#define PARALLEL_MARK_SUPPORTED
+#endif
+
+#ifdef PARALLEL_MARK_SUPPORTED
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+FORWARD_DECL(ParallelMarker);
+
+/// Gray objects of one marking thread, a split deque. The owner pushes and pops the private part
+/// at the bottom without locking. When other threads run out of work it moves the older half of
+/// it to the shared part, which the thieves take from the top under the lock.
+typedef struct MarkWorker {
+    ParallelMarker *marker;
+    size_t index;
+    Object **items; // [top, split) is shared, [split, bottom) is private.
+    size_t capacity;
+    size_t top;
+    size_t split;
+    size_t bottom;
+    atomic_size_t shared; // split - top, read without the lock to find a victim.
+    uint64_t round; // Last drain a helper took part in.
+    pthread_mutex_t lock;
+    pthread_t thread;
+} MarkWorker;
+
+/// Traverses gray objects on several threads. The collecting thread is workers[0], the helpers
+/// are started on the first drain and sleep between drains. While a drain runs ObjectMark claims
+/// objects with an atomic exchange of the mark, so every object is pushed and traversed once.
+typedef struct ParallelMarker {
+    MemoryManager *memory;
+    size_t threads_count; // With the collecting thread, 1 marks on it alone.
+    MarkWorker *workers; // NULL until the first drain.
+    bool draining;
+    uint64_t deadline;
+    uint64_t round;
+    size_t finished; // Helpers done with the current round.
+    bool quit;
+    atomic_size_t idle; // Workers that found nothing to steal.
+    atomic_bool stop; // Every worker is idle or the deadline has passed.
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+} ParallelMarker;
+
+#else
+
+typedef struct ParallelMarker {
+    size_t threads_count;
+} ParallelMarker;
+
+#endif
+
+/// One thread per CPU, at most GC_MAX_MARK_THREADS, or GC_STRESS_MARK_THREADS with GC_STRESS.
+void ParallelMarkerInit(ParallelMarker *self, MemoryManager *memory);
+
+void ParallelMarkerDeinit(ParallelMarker *self);
+
+#ifdef PARALLEL_MARK_SUPPORTED
+
+/// Traverses the gray stack of memory until it is empty or the deadline passes, the objects left
+/// gray are put back on it.
+void ParallelMarkerDrain(ParallelMarker *self, uint64_t deadline);
+
+/// Pushes onto the deque of the calling thread, MemoryManagerPushGray calls it while draining.
+void ParallelMarkerPush(ParallelMarker *self, Object *object);
+
+#endif
+
+#endif // LOOP_PARALLELMARKER_H
@@ -0,0 +1,210 @@
+#include "Sampler.h"
+
+#include "SlabAllocator.h"
+#include "VirtualMachine.h"
+
+#include "Objects/Function.h"
+#include "Objects/Module.h"
+#include "Objects/String.h"
+
+#ifdef SAMPLER_SUPPORTED
+#include <sys/time.h>
+#endif
+
+// Samples keep the functions of the frames and are formatted once the run is over. A compaction
+// only moves objects that fit in a slab cell, so functions must stay bigger than that.
+_Static_assert(sizeof(ObjectFunction) > SLAB_MAX_CELL_SIZE, "sampled functions must not be moved by compaction");
+
+// The signal handler has no argument to find the sampler with.
+static Sampler *active_sampler = NULL;
+
+#ifdef SAMPLER_SUPPORTED
+
+static void SamplerHandleSignal(int signal);
+
+static void SamplerSetTimer(long interval_us);
+
+#endif
+
+static char *FormatStack(const SamplerFrame *frames, size_t depth);
+
+static int CompareStacks(const void *a, const void *b);
+
+Error SamplerStart(Sampler *self, VirtualMachine *vm) {
+    assert(active_sampler == NULL);
+
+    self->vm = vm;
+    self->frames = malloc(sizeof(SamplerFrame) * SAMPLER_BUFFER_FRAMES);
+    self->frames_length = 0;
+    self->frames_capacity = SAMPLER_BUFFER_FRAMES;
+    self->depths = malloc(sizeof(uint32_t) * SAMPLER_BUFFER_FRAMES);
+    self->samples_length = 0;
+    self->samples_capacity = SAMPLER_BUFFER_FRAMES;
+    self->dropped = 0;
+    self->paused = false;
+
+    if (self->frames == NULL || self->depths == NULL) {
+        SamplerFree(self);
+        return Error_OutOfMemory;
+    }
+
+#ifdef SAMPLER_SUPPORTED
+    active_sampler = self;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SamplerHandleSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+
+    SamplerSetTimer(SAMPLER_INTERVAL_US);
+
+    return Error_None;
+#else
+    fprintf(USER_ERR, "error: sampling is not supported on this platform\n");
+    SamplerFree(self);
+    return Error_IOError;
+#endif
+}
+
+void SamplerStop(Sampler *self) {
+#ifdef SAMPLER_SUPPORTED
+    if (active_sampler == self) {
+        SamplerSetTimer(0);
+        signal(SIGPROF, SIG_DFL);
+        active_sampler = NULL;
+    }
+#endif
+}
+
+void SamplerFree(Sampler *self) {
+    SamplerStop(self);
+
+    free(self->frames);
+    free(self->depths);
+    self->frames = NULL;
+    self->depths = NULL;
+    self->frames_length = self->frames_capacity = 0;
+    self->samples_length = self->samples_capacity = 0;
+}
+
+#ifdef SAMPLER_SUPPORTED
+
+static void SamplerSetTimer(long interval_us) {
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval_us / 1000000;
+    timer.it_interval.tv_usec = interval_us % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+// Only copies pointers, nothing here may allocate or take a lock.
+static void SamplerHandleSignal(int signal) {
+    (void) signal;
+
+    Sampler *self = active_sampler;
+    if (self == NULL || self->paused) {
+        return;
+    }
+
+    const CallFrame *begin = self->vm->frames;
+    const CallFrame *end = self->vm->frame_ptr;
+
+    // The innermost frames are the interesting ones.
+    if (end - begin > SAMPLER_MAX_DEPTH) {
+        begin = end - SAMPLER_MAX_DEPTH;
+    }
+
+    const size_t depth = end - begin;
+    if (depth == 0) {
+        return;
+    }
+
+    if (self->samples_length == self->samples_capacity ||
+        self->frames_capacity - self->frames_length < depth) {
+        self->dropped++;
+        return;
+    }
+
+    for (const CallFrame *frame = begin; frame != end; ++frame) {
+        self->frames[self->frames_length++] = (SamplerFrame) {frame->function, frame->ip};
+    }
+
+    self->depths[self->samples_length++] = (uint32_t) depth;
+}
+
+#endif
+
+void SamplerWrite(const Sampler *self, FILE *out) {
+    char **stacks = malloc(sizeof(char *) * (self->samples_length + 1));
+    if (stacks == NULL) {
+        return;
+    }
+
+    size_t length = 0;
+    for (size_t i = 0, frame = 0; i < self->samples_length; frame += self->depths[i], ++i) {
+        char *stack = FormatStack(&self->frames[frame], self->depths[i]);
+        if (stack != NULL) {
+            stacks[length++] = stack;
+        }
+    }
+
+    qsort(stacks, length, sizeof(char *), CompareStacks);
+
+    for (size_t i = 0; i < length;) {
+        size_t j = i + 1;
+        while (j < length && strcmp(stacks[i], stacks[j]) == 0) {
+            ++j;
+        }
+
+        fprintf(out, "%s %zu\n", stacks[i], j - i);
+        i = j;
+    }
+
+    for (size_t i = 0; i < length; ++i) {
+        free(stacks[i]);
+    }
+    free(stacks);
+
+    if (self->dropped != 0) {
+        fprintf(USER_ERR, "warning: %zu samples did not fit and were dropped\n", self->dropped);
+    }
+}
+
+static char *FormatStack(const SamplerFrame *frames, size_t depth) {
+    size_t capacity = 64;
+    size_t length = 0;
+    char *stack = malloc(capacity);
+
+    for (size_t i = 0; i < depth && stack != NULL; ++i) {
+        const ObjectFunction *function = frames[i].function;
+
+        // The saved ip is past the current instruction of the innermost frame and past the
+        // call in the other ones, the byte before it belongs to the right line.
+        const size_t offset = (size_t) (frames[i].ip - function->chunk.code);
+        const size_t line = ChunkGetLine(&function->chunk, offset == 0 ? 0 : offset - 1);
+
+        const char *format = i == 0 ? "%s.%s:%zu" : ";%s.%s:%zu";
+        const int needed = snprintf(NULL, 0, format, function->module->name->str, function->name->str, line);
+
+        while (length + needed + 1 > capacity) {
+            capacity *= 2;
+            char *grown = realloc(stack, capacity);
+            if (grown == NULL) {
+                free(stack);
+                return NULL;
+            }
+            stack = grown;
+        }
+
+        length += snprintf(stack + length, capacity - length, format, function->module->name->str,
+                           function->name->str, line);
+    }
+
+    return stack;
+}
+
+static int CompareStacks(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
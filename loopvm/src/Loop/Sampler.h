@@ -0,0 +1,55 @@
+#ifndef LOOP_SAMPLER_H
+#define LOOP_SAMPLER_H
+
+#include "Common.h"
+
+#include <signal.h>
+#include <stdatomic.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SAMPLER_SUPPORTED
+#endif
+
+typedef struct SamplerFrame {
+    ObjectFunction *function;
+    const uint8_t *ip;
+} SamplerFrame;
+
+/// Function-level sampling profiler of loopvm --profile-samples.
+/// A SIGPROF handler copies the call frames into preallocated buffers, the root frame of every
+/// sample first. Names and lines are looked up only when the samples are written as collapsed
+/// stacks, the format of flamegraph.pl. Samples that do not fit are dropped and counted.
+typedef struct Sampler {
+    VirtualMachine *vm;
+    SamplerFrame *frames;
+    size_t frames_length;
+    size_t frames_capacity;
+    uint32_t *depths; // Frames in each sample.
+    size_t samples_length;
+    size_t samples_capacity;
+    size_t dropped;
+    volatile sig_atomic_t paused;
+} Sampler;
+
+/// Installs the signal handler and starts the timer, only one sampler can run at a time.
+Error SamplerStart(Sampler *self, VirtualMachine *vm);
+
+void SamplerStop(Sampler *self);
+
+/// The handler skips ticks while the frames are being moved.
+static inline void SamplerPause(Sampler *self) {
+    self->paused = true;
+    atomic_signal_fence(memory_order_seq_cst);
+}
+
+static inline void SamplerResume(Sampler *self) {
+    atomic_signal_fence(memory_order_seq_cst);
+    self->paused = false;
+}
+
+/// One line per distinct stack: `frame;frame;frame count`, every frame is `module.function:line`.
+void SamplerWrite(const Sampler *self, FILE *out);
+
+void SamplerFree(Sampler *self);
+
+#endif // LOOP_SAMPLER_H
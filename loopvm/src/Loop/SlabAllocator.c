@@ -0,0 +1,172 @@
+#include "SlabAllocator.h"
+
+// Cells start after the slab header, keep them aligned as malloc would.
+#define SLAB_HEADER_SIZE SLAB_SIZE_CLASS_STEP
+
+_Static_assert(sizeof(Slab) <= SLAB_HEADER_SIZE, "slab header must fit before the first cell");
+
+static SlabClass *GetClass(SlabAllocator *self, size_t size) {
+    assert(size > 0 && size <= SLAB_MAX_CELL_SIZE);
+    return &self->classes[(size - 1) / SLAB_SIZE_CLASS_STEP];
+}
+
+static size_t GetCellSize(size_t size) {
+    return (size + SLAB_SIZE_CLASS_STEP - 1) / SLAB_SIZE_CLASS_STEP * SLAB_SIZE_CLASS_STEP;
+}
+
+void SlabAllocatorInit(SlabAllocator *self) {
+    for (size_t i = 0; i < SLAB_SIZE_CLASSES_COUNT; ++i) {
+        self->classes[i].free_cells = NULL;
+        self->classes[i].bump = NULL;
+        self->classes[i].bump_end = NULL;
+    }
+
+    self->slabs = NULL;
+    self->slabs_count = 0;
+    self->live_bytes = 0;
+}
+
+static void FreeSlab(Slab *slab) {
+#ifdef LOOP_COMPILE_WINDOWS
+    _aligned_free(slab);
+#else
+    free(slab);
+#endif
+}
+
+void SlabAllocatorDeinit(SlabAllocator *self) {
+    Slab *slab = self->slabs;
+    while (slab != NULL) {
+        Slab *next = slab->next;
+        FreeSlab(slab);
+        slab = next;
+    }
+
+    SlabAllocatorInit(self);
+}
+
+static void NewSlab(SlabAllocator *self, SlabClass *klass) {
+#ifdef LOOP_COMPILE_WINDOWS
+    Slab *slab = _aligned_malloc(SLAB_SIZE, SLAB_SIZE);
+#else
+    Slab *slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+#endif
+    if (slab == NULL) {
+        fprintf(stderr, "FATAL ERROR: out of memory\n");
+        exit(1);
+    }
+
+    slab->next = self->slabs;
+    slab->live_cells = 0;
+    slab->cell_size = (uint16_t) ((size_t) (klass - self->classes + 1) * SLAB_SIZE_CLASS_STEP);
+    slab->evacuating = false;
+    self->slabs = slab;
+    ++self->slabs_count;
+
+    // The tail of the previous slab that is smaller than a cell is wasted.
+    klass->bump = (uint8_t *) slab + SLAB_HEADER_SIZE;
+    klass->bump_end = (uint8_t *) slab + SLAB_SIZE;
+}
+
+void *SlabAllocatorAllocate(SlabAllocator *self, size_t size) {
+    SlabClass *klass = GetClass(self, size);
+    const size_t cell_size = GetCellSize(size);
+    void *res;
+
+    if (klass->free_cells != NULL) {
+        SlabCell *cell = klass->free_cells;
+        klass->free_cells = cell->next;
+        res = cell;
+    } else {
+        if ((size_t) (klass->bump_end - klass->bump) < cell_size) {
+            NewSlab(self, klass);
+        }
+
+        res = klass->bump;
+        klass->bump += cell_size;
+    }
+
+    ++SlabAllocatorSlabOf(res)->live_cells;
+    self->live_bytes += cell_size;
+    return res;
+}
+
+void SlabAllocatorFree(SlabAllocator *self, void *ptr, size_t size) {
+    SlabClass *klass = GetClass(self, size);
+
+    --SlabAllocatorSlabOf(ptr)->live_cells;
+    self->live_bytes -= GetCellSize(size);
+
+    SlabCell *cell = ptr;
+    cell->next = klass->free_cells;
+    klass->free_cells = cell;
+}
+
+size_t SlabAllocatorBeginEvacuation(SlabAllocator *self, double occupancy) {
+    const double limit = occupancy * (SLAB_SIZE - SLAB_HEADER_SIZE);
+    size_t picked = 0;
+
+    for (Slab *slab = self->slabs; slab != NULL; slab = slab->next) {
+        slab->evacuating = (double) slab->live_cells * slab->cell_size <= limit;
+    }
+
+    // The bump pointer would hand out cells of its slab again. When every slab goes the classes
+    // start new ones.
+    for (size_t i = 0; i < SLAB_SIZE_CLASSES_COUNT; ++i) {
+        SlabClass *klass = &self->classes[i];
+
+        if (klass->bump_end == NULL) {
+            continue;
+        }
+
+        if (occupancy >= 1.0) {
+            klass->bump = NULL;
+            klass->bump_end = NULL;
+        } else {
+            SlabAllocatorSlabOf(klass->bump_end - 1)->evacuating = false;
+        }
+    }
+
+    for (Slab *slab = self->slabs; slab != NULL; slab = slab->next) {
+        picked += slab->evacuating;
+    }
+
+    if (picked == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < SLAB_SIZE_CLASSES_COUNT; ++i) {
+        SlabCell **link = &self->classes[i].free_cells;
+
+        while (*link != NULL) {
+            if (SlabAllocatorSlabOf(*link)->evacuating) {
+                *link = (*link)->next;
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+
+    return picked;
+}
+
+size_t SlabAllocatorEndEvacuation(SlabAllocator *self) {
+    Slab **link = &self->slabs;
+    size_t released = 0;
+
+    while (*link != NULL) {
+        Slab *slab = *link;
+
+        if (slab->evacuating) {
+            *link = slab->next;
+            self->live_bytes -= (size_t) slab->live_cells * slab->cell_size;
+            FreeSlab(slab);
+            ++released;
+        } else {
+            link = &slab->next;
+        }
+    }
+
+    self->slabs_count -= released;
+    return released;
+}
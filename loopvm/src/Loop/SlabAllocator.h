@@ -0,0 +1,63 @@
+#ifndef LOOP_SLABALLOCATOR_H
+#define LOOP_SLABALLOCATOR_H
+
+#include "Common.h"
+
+// Small objects are carved out of big slabs, one size class per 16 bytes up to 128 bytes. That covers
+// every object but functions, with tagged and untagged values, side arrays never come from slabs.
+// A class hands out freed cells first, then bumps a pointer through its current slab.
+// Slabs are aligned to their size, so the slab of a cell is found by masking its address.
+// They are released in SlabAllocatorDeinit, or once a compaction has moved their cells out.
+
+#define SLAB_SIZE (64 * 1024)
+#define SLAB_SIZE_CLASS_STEP 16
+#define SLAB_SIZE_CLASSES_COUNT 8
+#define SLAB_MAX_CELL_SIZE (SLAB_SIZE_CLASS_STEP * SLAB_SIZE_CLASSES_COUNT)
+
+typedef struct SlabCell {
+    struct SlabCell *next;
+} SlabCell;
+
+typedef struct Slab {
+    struct Slab *next;
+    uint32_t live_cells;
+    uint16_t cell_size;
+    bool evacuating; // Its cells are being moved to other slabs.
+} Slab;
+
+typedef struct SlabClass {
+    SlabCell *free_cells;
+    uint8_t *bump;
+    uint8_t *bump_end;
+} SlabClass;
+
+typedef struct SlabAllocator {
+    SlabClass classes[SLAB_SIZE_CLASSES_COUNT];
+    Slab *slabs;
+    size_t slabs_count;
+    size_t live_bytes; // Of the cells in use, rounded up to the cell size.
+} SlabAllocator;
+
+void SlabAllocatorInit(SlabAllocator *self);
+
+void SlabAllocatorDeinit(SlabAllocator *self);
+
+/// size must be in (0, SLAB_MAX_CELL_SIZE].
+void *SlabAllocatorAllocate(SlabAllocator *self, size_t size);
+
+/// size must be the one that was passed to SlabAllocatorAllocate.
+void SlabAllocatorFree(SlabAllocator *self, void *ptr, size_t size);
+
+static inline Slab *SlabAllocatorSlabOf(const void *cell) {
+    return (Slab *) ((uintptr_t) cell & ~(uintptr_t) (SLAB_SIZE - 1));
+}
+
+/// Picks the slabs whose live cells take at most occupancy of them, except the ones the classes
+/// bump through unless occupancy is 1, and takes their free cells out of the free lists. New cells
+/// come from the other slabs until SlabAllocatorEndEvacuation. Returns the number of slabs picked.
+size_t SlabAllocatorBeginEvacuation(SlabAllocator *self, double occupancy);
+
+/// Releases the picked slabs, their live cells must have been moved out. Returns their number.
+size_t SlabAllocatorEndEvacuation(SlabAllocator *self);
+
+#endif // LOOP_SLABALLOCATOR_H
@@ -1,5 +1,7 @@
 #include "Value.h"
 
+#include <inttypes.h>
+
 #include "Object.h"
 
 #include "Objects/String.h"
@@ -29,70 +31,26 @@ Value ValueFromJSON(VirtualMachine *vm, ObjectModule *module, const cJSON *json)
         const cJSON *value = cJSON_GetObjectItemCaseSensitive(json, "data");
         assert(cJSON_IsNumber(value));
 
-        return ValueInt(value->valueint);
+        // cJSON keeps numbers as doubles, ints beyond 2^53 only survive the binary format.
+        return ValueInt((int64_t) value->valuedouble);
     }
 
     return ValueObject(ObjectFromJSON(vm, module, json));
 }
 
-Value ValueNull() {
-    Value result;
-    result.type = ValueType_Null;
-    result.as.integer = 0;
-    return result;
-}
-
-Value ValueBool(bool value) {
-    Value result;
-    result.type = ValueType_Bool;
-    result.as.boolean = value;
-    return result;
-}
-
-Value ValueInt(int value) {
-    Value result;
-    result.type = ValueType_Int;
-    result.as.integer = value;
-    return result;
-}
-
-Value ValueObject(Object *value) {
-    Value result;
-    result.type = ValueType_Object;
-    result.as.object = value;
-    return result;
-}
-
-ValueType ValueGetType(Value self) {
-    return self.type;
-}
-
-bool ValueIsNull(Value self) {
-    return ValueGetType(self) == ValueType_Null;
-}
-
-bool ValueIsBool(Value self) {
-    return ValueGetType(self) == ValueType_Bool;
-}
-
-bool ValueIsInt(Value self) {
-    return ValueGetType(self) == ValueType_Int;
-}
-
-bool ValueIsObject(Value self) {
-    return ValueGetType(self) == ValueType_Object;
-}
-
-bool ValueAsBool(Value self) {
-    return self.as.boolean;
-}
+Value ValueFromBytecode(VirtualMachine *vm, ObjectModule *module, BytecodeReader *reader) {
+    const BytecodeType type = BytecodeReadU8(reader);
 
-int ValueAsInt(Value self) {
-    return self.as.integer;
-}
+    if (type == BytecodeType_Integer) {
+        const int64_t value = BytecodeReadI64(reader);
+        if (value < VALUE_INT_MIN || value > VALUE_INT_MAX) {
+            reader->failed = true;
+        }
+        return ValueInt(value);
+    }
 
-Object *ValueAsObject(Value self) {
-    return self.as.object;
+    Object *obj = ObjectFromBytecode(vm, module, type, reader);
+    return obj == NULL ? ValueNull() : ValueObject(obj);
 }
 
 void ValuePrint(Value self, FILE *out) {
@@ -104,7 +62,7 @@ void ValuePrint(Value self, FILE *out) {
             fprintf(out, "%s", ValueAsBool(self) ? "true" : "false");
             break;
         case ValueType_Int:
-            fprintf(out, "%d", ValueAsInt(self));
+            fprintf(out, "%" PRId64, ValueAsInt(self));
             break;
         case ValueType_Object:
             ObjectPrint(ValueAsObject(self), out);
@@ -113,6 +71,13 @@ void ValuePrint(Value self, FILE *out) {
 }
 
 bool ValueAreEqual(Value a, Value b) {
+#ifdef VALUE_TAGGED
+
+    // Every value has exactly one encoding, objects are compared by identity.
+    return a.bits == b.bits;
+
+#else
+
     if (ValueGetType(a) != ValueGetType(b)) {
         return false;
     }
@@ -127,6 +92,8 @@ bool ValueAreEqual(Value a, Value b) {
         case ValueType_Object:
             return ValueAsObject(a) == ValueAsObject(b);
     }
+
+#endif
 }
 
 size_t ValueHash(Value self) {
@@ -148,23 +115,14 @@ size_t ValueHash(Value self) {
     }
 }
 
-bool ValueIsTrue(Value self) {
-    return !ValueIsFalse(self);
-}
-
-bool ValueIsFalse(Value self) {
-    switch (ValueGetType(self)) {
-        case ValueType_Null:
-            return true;
-        case ValueType_Bool:
-            return !ValueAsBool(self);
-        default:
-            return false;
-    }
-}
-
 void ValueMark(Value self, MemoryManager *memory) {
     if (ValueIsObject(self)) {
         ObjectMark(ValueAsObject(self), memory);
     }
 }
+
+void ValueRelocate(Value *self, MemoryManager *memory) {
+    if (ValueIsObject(*self)) {
+        *self = ValueObject(ObjectRelocate(ValueAsObject(*self), memory));
+    }
+}
@@ -3,6 +3,8 @@
 
 #include "Common.h"
 
+#include "Bytecode.h"
+
 // TODO: YOU CANNOT USE NULL TO INDEX DICTIONARIES.
 
 #define ValueType_LIST(o) \
@@ -21,9 +23,37 @@ typedef enum ValueType {
 
 const char *ValueTypeToString(ValueType value);
 
+#ifdef VALUE_TAGGED
+
+// The whole value is one 64-bit word, the two low bits are the tag. Objects are at least
+// 4-byte aligned, so an object is stored as the bare pointer with tag 0.
+
+#define VALUE_TAG_MASK 0x3
+#define VALUE_TAG_OBJECT 0x0
+#define VALUE_TAG_INT 0x1
+#define VALUE_TAG_BOOL 0x2
+#define VALUE_TAG_NULL 0x3
+
+#define VALUE_PAYLOAD_SHIFT 2
+
+// Ints keep the 62 bits above the tag.
+#define VALUE_INT_MIN (INT64_MIN >> VALUE_PAYLOAD_SHIFT)
+#define VALUE_INT_MAX (INT64_MAX >> VALUE_PAYLOAD_SHIFT)
+
+typedef struct Value {
+    uint64_t bits;
+} Value;
+
+_Static_assert(sizeof(Value) == sizeof(uint64_t), "tagged Value must fit in a machine word");
+
+#else
+
+#define VALUE_INT_MIN INT64_MIN
+#define VALUE_INT_MAX INT64_MAX
+
 typedef union ValueUnion {
     bool boolean;
-    int integer;
+    int64_t integer;
     Object *object;
 } ValueUnion;
 
@@ -32,32 +62,202 @@ typedef struct Value {
     ValueUnion as;
 } Value;
 
+#endif
+
 /// Use this function with caution. module_path will be set to NULL.
 Value ValueFromJSON(VirtualMachine *vm, ObjectModule *module, const cJSON *json);
 
-Value ValueNull();
+Value ValueFromBytecode(VirtualMachine *vm, ObjectModule *module, BytecodeReader *reader);
+
+// Constructors and accessors are used in every instruction, so they are defined right here.
+
+#ifdef VALUE_TAGGED
+
+static inline Value ValueNull() {
+    return (Value) {VALUE_TAG_NULL};
+}
+
+static inline Value ValueBool(bool value) {
+    return (Value) {((uint64_t) value << VALUE_PAYLOAD_SHIFT) | VALUE_TAG_BOOL};
+}
+
+static inline Value ValueInt(int64_t value) {
+    return (Value) {((uint64_t) value << VALUE_PAYLOAD_SHIFT) | VALUE_TAG_INT};
+}
+
+static inline Value ValueObject(Object *value) {
+    return (Value) {(uint64_t) (uintptr_t) value};
+}
+
+static inline ValueType ValueGetType(Value self) {
+    switch (self.bits & VALUE_TAG_MASK) {
+        case VALUE_TAG_OBJECT:
+            return ValueType_Object;
+        case VALUE_TAG_INT:
+            return ValueType_Int;
+        case VALUE_TAG_BOOL:
+            return ValueType_Bool;
+        default:
+            return ValueType_Null;
+    }
+}
+
+static inline bool ValueIsNull(Value self) {
+    return self.bits == VALUE_TAG_NULL;
+}
+
+static inline bool ValueIsBool(Value self) {
+    return (self.bits & VALUE_TAG_MASK) == VALUE_TAG_BOOL;
+}
+
+static inline bool ValueIsInt(Value self) {
+    return (self.bits & VALUE_TAG_MASK) == VALUE_TAG_INT;
+}
+
+static inline bool ValueIsObject(Value self) {
+    return (self.bits & VALUE_TAG_MASK) == VALUE_TAG_OBJECT;
+}
 
-Value ValueBool(bool value);
+static inline bool ValueAsBool(Value self) {
+    return self.bits >> VALUE_PAYLOAD_SHIFT;
+}
 
-Value ValueInt(int value);
+static inline int64_t ValueAsInt(Value self) {
+    return (int64_t) self.bits >> VALUE_PAYLOAD_SHIFT;
+}
 
-Value ValueObject(Object *value);
+static inline Object *ValueAsObject(Value self) {
+    return (Object *) (uintptr_t) self.bits;
+}
 
-ValueType ValueGetType(Value self);
+#else
 
-bool ValueIsNull(Value self);
+static inline Value ValueNull() {
+    Value result;
+    result.type = ValueType_Null;
+    result.as.integer = 0;
+    return result;
+}
 
-bool ValueIsBool(Value self);
+static inline Value ValueBool(bool value) {
+    Value result;
+    result.type = ValueType_Bool;
+    result.as.boolean = value;
+    return result;
+}
 
-bool ValueIsInt(Value self);
+static inline Value ValueInt(int64_t value) {
+    Value result;
+    result.type = ValueType_Int;
+    result.as.integer = value;
+    return result;
+}
 
-bool ValueIsObject(Value self);
+static inline Value ValueObject(Object *value) {
+    Value result;
+    result.type = ValueType_Object;
+    result.as.object = value;
+    return result;
+}
 
-bool ValueAsBool(Value self);
+static inline ValueType ValueGetType(Value self) {
+    return self.type;
+}
 
-int ValueAsInt(Value self);
+static inline bool ValueIsNull(Value self) {
+    return ValueGetType(self) == ValueType_Null;
+}
 
-Object *ValueAsObject(Value self);
+static inline bool ValueIsBool(Value self) {
+    return ValueGetType(self) == ValueType_Bool;
+}
+
+static inline bool ValueIsInt(Value self) {
+    return ValueGetType(self) == ValueType_Int;
+}
+
+static inline bool ValueIsObject(Value self) {
+    return ValueGetType(self) == ValueType_Object;
+}
+
+static inline bool ValueAsBool(Value self) {
+    return self.as.boolean;
+}
+
+static inline int64_t ValueAsInt(Value self) {
+    return self.as.integer;
+}
+
+static inline Object *ValueAsObject(Value self) {
+    return self.as.object;
+}
+
+#endif
+
+// Int arithmetic of two ints. Like __builtin_add_overflow and friends they return true if the
+// result does not fit in an int, *result is undefined then.
+
+#ifdef VALUE_TAGGED
+
+// The operations work on the tagged words: with the tag taken off one operand the 64-bit
+// operation yields the tagged result and overflows exactly when the int does.
+
+static inline bool ValueIntAdd(Value a, Value b, Value *result) {
+    int64_t bits;
+    const bool overflow = __builtin_add_overflow((int64_t) a.bits, (int64_t) (b.bits - VALUE_TAG_INT), &bits);
+    result->bits = (uint64_t) bits;
+    return overflow;
+}
+
+static inline bool ValueIntSubtract(Value a, Value b, Value *result) {
+    int64_t bits;
+    const bool overflow = __builtin_sub_overflow((int64_t) a.bits, (int64_t) (b.bits - VALUE_TAG_INT), &bits);
+    result->bits = (uint64_t) bits;
+    return overflow;
+}
+
+static inline bool ValueIntMultiply(Value a, Value b, Value *result) {
+    int64_t bits;
+    const bool overflow = __builtin_mul_overflow((int64_t) (a.bits - VALUE_TAG_INT), ValueAsInt(b), &bits);
+    result->bits = (uint64_t) bits | VALUE_TAG_INT;
+    return overflow;
+}
+
+#else
+
+static inline bool ValueIntAdd(Value a, Value b, Value *result) {
+    *result = ValueInt(0);
+    return __builtin_add_overflow(ValueAsInt(a), ValueAsInt(b), &result->as.integer);
+}
+
+static inline bool ValueIntSubtract(Value a, Value b, Value *result) {
+    *result = ValueInt(0);
+    return __builtin_sub_overflow(ValueAsInt(a), ValueAsInt(b), &result->as.integer);
+}
+
+static inline bool ValueIntMultiply(Value a, Value b, Value *result) {
+    *result = ValueInt(0);
+    return __builtin_mul_overflow(ValueAsInt(a), ValueAsInt(b), &result->as.integer);
+}
+
+#endif
+
+static inline bool ValueIntNegate(Value a, Value *result) {
+    if (ValueAsInt(a) == VALUE_INT_MIN) {
+        return true;
+    }
+
+    *result = ValueInt(-ValueAsInt(a));
+    return false;
+}
+
+static inline bool ValueIsFalse(Value self) {
+    return ValueIsNull(self) || (ValueIsBool(self) && !ValueAsBool(self));
+}
+
+static inline bool ValueIsTrue(Value self) {
+    return !ValueIsFalse(self);
+}
 
 void ValuePrint(Value self, FILE *out);
 
@@ -65,10 +265,8 @@ bool ValueAreEqual(Value a, Value b);
 
 size_t ValueHash(Value self);
 
-bool ValueIsTrue(Value self);
-
-bool ValueIsFalse(Value self);
-
 void ValueMark(Value self, MemoryManager *memory);
 
+void ValueRelocate(Value *self, MemoryManager *memory);
+
 #endif // LOOP_VALUE_H
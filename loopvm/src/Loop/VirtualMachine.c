@@ -1,6 +1,8 @@
 #include "VirtualMachine.h"
 
+#include "Bytecode.h"
 #include "Filesystem.h"
+#include "Jit.h"
 #include "Object.h"
 #include "Opcode.h"
 
@@ -13,6 +15,7 @@
 #include "Objects/Instance.h"
 #include "Objects/List.h"
 #include "Objects/Module.h"
+#include "Objects/Shape.h"
 #include "Objects/Upvalue.h"
 
 void CommonObjectsInit(CommonObjects *self, VirtualMachine *vm) {
@@ -21,6 +24,7 @@ void CommonObjectsInit(CommonObjects *self, VirtualMachine *vm) {
     self->empty_string = ObjectStringFromLiteral(vm, "");
     self->dot_code = ObjectStringFromLiteral(vm, ".code");
     self->compiled_dir = ObjectStringFromLiteral(vm, ".loop_compiled");
+    self->empty_shape = ObjectShapeNew(vm);
 }
 
 void CommonObjectsDeinit(CommonObjects *self) {
@@ -29,6 +33,7 @@ void CommonObjectsDeinit(CommonObjects *self) {
     self->script = NULL;
     self->dot_code = NULL;
     self->compiled_dir = NULL;
+    self->empty_shape = NULL;
 }
 
 void CommonObjectsMarkTraverse(CommonObjects *self, MemoryManager *memory) {
@@ -37,14 +42,44 @@ void CommonObjectsMarkTraverse(CommonObjects *self, MemoryManager *memory) {
     ObjectMark((Object *) self->script, memory);
     ObjectMark((Object *) self->dot_code, memory);
     ObjectMark((Object *) self->compiled_dir, memory);
+    ObjectMark((Object *) self->empty_shape, memory);
+}
+
+void CommonObjectsRelocateTraverse(CommonObjects *self, MemoryManager *memory) {
+    self->empty_string = (ObjectString *) ObjectRelocate((Object *) self->empty_string, memory);
+    self->init = (ObjectString *) ObjectRelocate((Object *) self->init, memory);
+    self->script = (ObjectString *) ObjectRelocate((Object *) self->script, memory);
+    self->dot_code = (ObjectString *) ObjectRelocate((Object *) self->dot_code, memory);
+    self->compiled_dir = (ObjectString *) ObjectRelocate((Object *) self->compiled_dir, memory);
+    self->empty_shape = (ObjectShape *) ObjectRelocate((Object *) self->empty_shape, memory);
+}
+
+static void *AllocateStack(void *ptr, size_t size) {
+    void *res = realloc(ptr, size);
+    if (res == NULL) {
+        fprintf(stderr, "FATAL ERROR: out of memory\n");
+        exit(1);
+    }
+
+    return res;
 }
 
 Error VirtualMachineInit(VirtualMachine *self) {
     MemoryManagerInit(&self->memory_manager, self); // Potential bug, if conf is not set in VM.
     self->memory_manager.on = false;
+    self->stack = AllocateStack(NULL, sizeof(Value) * VM_STACK_SIZE_PER_FRAME * VM_FRAMES_INITIAL_COUNT);
     self->stack_ptr = self->stack;
+    self->stack_end = self->stack + VM_STACK_SIZE_PER_FRAME * VM_FRAMES_INITIAL_COUNT;
+    self->frames = AllocateStack(NULL, sizeof(CallFrame) * VM_FRAMES_INITIAL_COUNT);
     self->frame_ptr = self->frames;
+    self->frames_end = self->frames + VM_FRAMES_INITIAL_COUNT;
+    self->handlers = AllocateStack(NULL, sizeof(CatchHandler) * VM_HANDLERS_INITIAL_COUNT);
     self->handler_ptr = self->handlers;
+    self->handlers_end = self->handlers + VM_HANDLERS_INITIAL_COUNT;
+    self->open_upvalues = NULL;
+    self->opcode_profile = NULL;
+    self->sampler = NULL;
+    self->jit = true;
     HashTableInit(&self->strings);
     HashTableInitWithCapacity(&self->modules, self);
     CommonObjectsInit(&self->common, self); // Bug if a lot is not set.
@@ -67,8 +102,6 @@ Error VirtualMachineInit(VirtualMachine *self) {
 
     self->packages_path = ObjectStringFromLiteral(self, packages_path);
 
-    self->open_upvalues = NULL;
-
     return Error_None;
 }
 
@@ -79,8 +112,12 @@ void VirtualMachineDeinit(VirtualMachine *self) {
     self->called_path = NULL;
     HashTableDeinit(&self->modules, self);
     HashTableDeinit(&self->strings, self);
-    self->frame_ptr = NULL;
-    self->stack_ptr = NULL;
+    free(self->handlers);
+    self->handlers = self->handler_ptr = self->handlers_end = NULL;
+    free(self->frames);
+    self->frames = self->frame_ptr = self->frames_end = NULL;
+    free(self->stack);
+    self->stack = self->stack_ptr = self->stack_end = NULL;
     CommonObjectsDeinit(&self->common);
     MemoryManagerDeinit(&self->memory_manager);
 }
@@ -91,16 +128,18 @@ static Error PushFrame(VirtualMachine *self, ObjectFunction *function, ObjectClo
 
 static Error PopFrame(VirtualMachine *self);
 
-static Value StackPeek(VirtualMachine *self);
+static Error GrowStack(VirtualMachine *self, size_t needed);
+
+static Error GrowFrames(VirtualMachine *self);
 
-static void StackPeekSet(VirtualMachine *self, Value value);
+static Error GrowHandlers(VirtualMachine *self);
+
+static Value StackPeek(VirtualMachine *self);
 
 static Value StackPeekAt(VirtualMachine *self, size_t offset);
 
 static Value StackPop(VirtualMachine *self);
 
-static void StackPopSeveral(VirtualMachine *self, size_t count);
-
 static void StackPush(VirtualMachine *self, Value value);
 
 static ObjectModule *GetModule(CallFrame *frame);
@@ -109,16 +148,10 @@ static ObjectFunction *GetFunction(CallFrame *frame);
 
 static Value GetGlobal(CallFrame *frame, size_t arg);
 
-static void SetGlobal(CallFrame *frame, size_t arg, Value value);
+static void SetGlobal(VirtualMachine *self, CallFrame *frame, size_t arg, Value value);
 
 static HashTable *GetExports(CallFrame *frame);
 
-static uint8_t ReadByte(CallFrame *frame);
-
-static uint16_t ReadShort(CallFrame *frame);
-
-static Value ReadConstant(CallFrame *frame);
-
 static void TraceStack(VirtualMachine *self);
 
 typedef enum BinaryOp {
@@ -128,6 +161,8 @@ typedef enum BinaryOp {
     BinaryOp_Divide,
     BinaryOp_Greater,
     BinaryOp_Less,
+    BinaryOp_LessEqual,
+    BinaryOp_GreaterEqual,
 } BinaryOp;
 
 static Error BinOp(VirtualMachine *self, BinaryOp op);
@@ -138,9 +173,14 @@ static Error GetItem(VirtualMachine *self, Value value, uint8_t arity);
 
 static Error SetItem(VirtualMachine *self, Value value, uint8_t arity);
 
-static Error GetAttribute(VirtualMachine *self, Value from, Value attr);
+static Error GetAttribute(VirtualMachine *self, Value from, ObjectFunction *function, uint16_t constant);
 
-static Error SetAttribute(VirtualMachine *self, Value instance, Value key, Value value);
+static Error SetAttribute(VirtualMachine *self, Value instance, Value value, ObjectFunction *function,
+                          uint16_t constant);
+
+static Error Invoke(VirtualMachine *self, ObjectFunction *function, uint16_t constant, uint8_t arity);
+
+static bool IsInstanceOf(Value value, ObjectClass *klass);
 
 static ObjectUpvalue *CaptureUpvalue(VirtualMachine *self, Value *location);
 
@@ -219,18 +259,24 @@ static bool InternModule(VirtualMachine *self, ObjectString *path, ObjectModule
 }
 
 static Error LoadNewModule(VirtualMachine *self, ObjectString *path, ObjectModule **ptr) {
-    char *buffer = NULL;
-    TRY(ReadFileWithComments(USER_ERR, path->str, &buffer));
+    const uint8_t *buffer = NULL;
+    size_t size = 0;
+    TRY(MapFile(USER_ERR, path->str, &buffer, &size));
+
+    if (BytecodeIsBinary(buffer, size)) {
+        return ObjectModuleFromBytecode(self, path, buffer, size, ptr);
+    }
+
+    // Modules compiled before the binary format.
+    cJSON *data = cJSON_ParseWithLength((const char *) buffer, size);
+    UnmapFile(buffer, size);
 
-    cJSON *data = cJSON_Parse(buffer);
     if (data == NULL) {
         fprintf(USER_ERR, "error: failed to parse JSON for '%s'.\n",
                 path->str);
         return Error_InvalidJSON;
     }
 
-    free(buffer);
-
     *ptr = ObjectModuleFromJSON(self, path, data);
 
     cJSON_Delete(data);
@@ -267,190 +313,549 @@ static Error LoadNewModule(VirtualMachine *self, ObjectString *path, ObjectModul
         } \
     } while (0)
 
-Error Run(VirtualMachine *self) {
-    while (true) {
-        CallFrame *frame = &self->frame_ptr[-1];
+// Run() keeps the instruction pointer, the stack pointer and the current frame in locals.
+// They must be written back before calling anything that looks at the VM state (helpers
+// push and pop through self->stack_ptr, and any allocation may start the GC), and
+// reloaded afterwards if the callee could have changed them.
+
+#define STORE_REGISTERS() \
+    do \
+    { \
+        frame->ip = ip; \
+        self->stack_ptr = sp; \
+    } while (false)
+
+#define LOAD_REGISTERS() \
+    do \
+    { \
+        frame = &self->frame_ptr[-1]; \
+        ip = frame->ip; \
+        sp = self->stack_ptr; \
+    } while (false)
+
+#define READ_BYTE() (*ip++)
+
+#define READ_SHORT() (ip += 2, (uint16_t) ((ip[-1] << 8) | ip[-2]))
+
+#define READ_LONG() (ip += 4, (uint32_t) ip[-4] | ((uint32_t) ip[-3] << 8) | \
+                     ((uint32_t) ip[-2] << 16) | ((uint32_t) ip[-1] << 24))
+
+// The opcodes of Opcode_WIDE_LIST read their first operand with READ_OPERAND(). Wide reads
+// the wider operand itself and jumps to the label right after the read.
+#define READ_OPERAND(name, read) operand = (read); Wide_##name:
+
+#define CONSTANT(index) (frame->function->chunk.constants[index])
+
+#define PUSH(value) (*sp++ = (value))
+#define POP() (*--sp)
+#define PEEK() (sp[-1])
+#define PEEK_AT(offset) (sp[-1 - (offset)])
 
 #ifdef VM_TRACE_EXECUTION
 
-        TraceStack(self);
-        ChunkDisassembleInstruction(&frame->function->chunk, DEBUG_OUT, frame->ip);
+#define TRACE_INSTRUCTION() \
+    do \
+    { \
+        STORE_REGISTERS(); \
+        TraceStack(self); \
+        ChunkDisassembleInstruction(&frame->function->chunk, DEBUG_OUT, ip); \
+    } while (false)
+
+#else
+
+#define TRACE_INSTRUCTION() do {} while (false)
+
+#endif
+
+// With computed goto every handler jumps straight to the next one through dispatch_table,
+// the switch is only used to enter the first instruction. When profiling every entry of the
+// table in use leads to Label_Instrumented instead, which does INSTRUMENT() and jumps on.
+
+// The sampler reads the ip of the innermost frame from its signal handler, so it is stored
+// before every instruction.
+#define INSTRUMENT() \
+    do \
+    { \
+        if (self->opcode_profile != NULL) \
+        { \
+            OpcodeProfileRecord(self->opcode_profile, opcode); \
+        } \
+        if (self->sampler != NULL) \
+        { \
+            frame->ip = ip; \
+        } \
+    } while (false)
+
+#ifdef JIT_SUPPORTED
+
+// Where the interpreter enters a function, at calls, returns into it and loop back edges, it
+// runs the machine code of the function if there is some. The code hands back the instruction
+// it cannot run, the interpreter carries on from there. Functions without code count the entries.
+#define JIT_ENTER() \
+    do \
+    { \
+        if (jit) \
+        { \
+            ObjectFunction *jit_function = frame->function; \
+            if (jit_function->jit == NULL && jit_function->jit_counter < JIT_THRESHOLD && \
+                ++jit_function->jit_counter == JIT_THRESHOLD) \
+            { \
+                JitCompile(self, jit_function); \
+            } \
+            if (jit_function->jit != NULL) \
+            { \
+                ip = JitRun(self, frame, ip, &sp); \
+            } \
+        } \
+    } while (false)
+
+#else
+
+#define JIT_ENTER() do {} while (false)
+
+#endif
+
+#ifdef COMPACTING_SUPPORTED
+
+// Where the interpreter may enter the JIT it also lets a requested compaction run. Between
+// instructions it holds no object pointers of its own, frame, ip and sp do not point into objects.
+#define SAFEPOINT() \
+    do \
+    { \
+        if (self->memory_manager.compaction_requested) \
+        { \
+            STORE_REGISTERS(); \
+            MemoryManagerCompact(&self->memory_manager); \
+        } \
+    } while (false)
+
+#else
+
+#define SAFEPOINT() do {} while (false)
+
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+
+#define VM_CASE(name) case Opcode_##name: Label_##name
+#define VM_DEFAULT default: Label_Unknown
+
+#define DISPATCH() \
+    do \
+    { \
+        TRACE_INSTRUCTION(); \
+        opcode = READ_BYTE(); \
+        goto *dispatch[opcode]; \
+    } while (false)
+
+#else
+
+#define VM_CASE(name) case Opcode_##name
+#define VM_DEFAULT default
+
+#define DISPATCH() continue
+
+#endif
+
+Error Run(VirtualMachine *self) {
+#ifdef VM_COMPUTED_GOTO
+
+    static const void *dispatch_table[256] = {
+        [0 ... 255] = &&Label_Unknown,
+
+#define Opcode_LABEL(name, _) [Opcode_##name] = &&Label_##name,
+
+        Opcode_LIST(Opcode_LABEL)
+
+#undef Opcode_LABEL
+    };
+
+    static const void *instrumented_table[256] = {
+        [0 ... 255] = &&Label_Instrumented,
+    };
 
 #endif
 
-        Opcode opcode = ReadByte(frame);
+    const bool instrumented = self->opcode_profile != NULL || self->sampler != NULL;
+
+#ifdef JIT_SUPPORTED
+    // The generated code neither counts opcodes nor keeps the ip up to date for the sampler.
+    const bool jit = self->jit && !instrumented;
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+    const void *const *dispatch = instrumented ? instrumented_table : dispatch_table;
+#endif
+
+    CallFrame *frame;
+    const uint8_t *ip;
+    Value *sp;
+    uint8_t opcode;
+    uint32_t operand;
+
+    LOAD_REGISTERS();
+
+    while (true) {
+        TRACE_INSTRUCTION();
+
+        opcode = READ_BYTE();
+
+        if (instrumented) {
+            INSTRUMENT();
+        }
 
         switch (opcode) {
-            case Opcode_PushConstant: {
-                Value value = ReadConstant(frame);
-                StackPush(self, value);
-                break;
+            VM_CASE(PushConstant): {
+                READ_OPERAND(PushConstant, READ_BYTE());
+                PUSH(CONSTANT(operand));
+                DISPATCH();
             }
 
-            case Opcode_PushFalse: {
-                StackPush(self, ValueBool(false));
-                break;
+            VM_CASE(PushFalse): {
+                PUSH(ValueBool(false));
+                DISPATCH();
             }
 
-            case Opcode_PushTrue: {
-                StackPush(self, ValueBool(true));
-                break;
+            VM_CASE(PushTrue): {
+                PUSH(ValueBool(true));
+                DISPATCH();
             }
 
-            case Opcode_PushNull: {
-                StackPush(self, ValueNull());
-                break;
+            VM_CASE(PushNull): {
+                PUSH(ValueNull());
+                DISPATCH();
             }
 
-            case Opcode_Negate: {
-                Value value = StackPeek(self);
+            VM_CASE(Negate): {
+                Value value = PEEK();
                 CHECK_VALUE_TYPE(self, value, Int);
-                StackPeekSet(self, ValueInt(-ValueAsInt(value)));
-                break;
+                if (ValueIntNegate(value, &PEEK())) {
+                    fprintf(USER_ERR, "error: integer overflow\n");
+                    return Error_IntegerOverflow;
+                }
+                DISPATCH();
             }
 
-            case Opcode_Not: {
-                Value value = StackPeek(self);
-                StackPeekSet(self, ValueBool(ValueIsFalse(value)));
-                break;
+            VM_CASE(Not): {
+                PEEK() = ValueBool(ValueIsFalse(PEEK()));
+                DISPATCH();
             }
 
-            case Opcode_Plus: {
-                break;
+            VM_CASE(Plus): {
+                DISPATCH();
+            }
+
+            // Two ints are handled in place on the stack. Anything else, overflows and division
+            // by zero go through BinOp, which reports them.
+
+#define BIN_OP_FALLBACK(self, op) \
+            do \
+            { \
+                STORE_REGISTERS(); \
+                TRY(BinOp(self, BinaryOp_##op)); \
+                sp = self->stack_ptr; \
+            } while (false)
+
+#define INT_ARITHMETIC(self, op) \
+            VM_CASE(op): { \
+                Value b = PEEK(); \
+                Value a = PEEK_AT(1); \
+                Value result; \
+                if (ValueIsInt(a) && ValueIsInt(b) && !ValueInt##op(a, b, &result)) { \
+                    --sp; \
+                    PEEK() = result; \
+                } else { \
+                    BIN_OP_FALLBACK(self, op); \
+                } \
+                DISPATCH(); \
+            }
+
+#define INT_COMPARISON(self, op, operator) \
+            VM_CASE(op): { \
+                Value b = PEEK(); \
+                Value a = PEEK_AT(1); \
+                if (ValueIsInt(a) && ValueIsInt(b)) { \
+                    --sp; \
+                    PEEK() = ValueBool(ValueAsInt(a) operator ValueAsInt(b)); \
+                } else { \
+                    BIN_OP_FALLBACK(self, op); \
+                } \
+                DISPATCH(); \
+            }
+
+            INT_ARITHMETIC(self, Add)
+            INT_ARITHMETIC(self, Subtract)
+            INT_ARITHMETIC(self, Multiply)
+            INT_COMPARISON(self, Greater, >)
+            INT_COMPARISON(self, Less, <)
+            INT_COMPARISON(self, LessEqual, <=)
+            INT_COMPARISON(self, GreaterEqual, >=)
+
+#undef INT_ARITHMETIC
+#undef INT_COMPARISON
+
+            VM_CASE(Divide): {
+                Value b = PEEK();
+                Value a = PEEK_AT(1);
+                if (ValueIsInt(a) && ValueIsInt(b) && ValueAsInt(b) != 0
+                    && !(ValueAsInt(a) == VALUE_INT_MIN && ValueAsInt(b) == -1)) {
+                    --sp;
+                    PEEK() = ValueInt(ValueAsInt(a) / ValueAsInt(b));
+                } else {
+                    BIN_OP_FALLBACK(self, Divide);
+                }
+                DISPATCH();
+            }
+
+#undef BIN_OP_FALLBACK
+
+            // Superinstructions for the hottest sequences of numeric loops, emitted by loopc -O.
+            // Ints take the inline path, anything else goes through BinOp like the sequence they
+            // replace would.
+
+#define SLOW_BIN_OP(op, a, b, result) \
+            do \
+            { \
+                PUSH(a); \
+                PUSH(b); \
+                STORE_REGISTERS(); \
+                TRY(BinOp(self, BinaryOp_##op)); \
+                sp = self->stack_ptr; \
+                result = POP(); \
+            } while (false)
+
+            VM_CASE(AddLocalLocal): {
+                Value a = frame->locals[READ_BYTE()];
+                Value b = frame->locals[READ_BYTE()];
+                Value result;
+
+                if (!ValueIsInt(a) || !ValueIsInt(b) || ValueIntAdd(a, b, &result)) {
+                    SLOW_BIN_OP(Add, a, b, result);
+                }
+
+                PUSH(result);
+                DISPATCH();
+            }
+
+            VM_CASE(IncrementLocal): {
+                uint8_t index = READ_BYTE();
+                Value a = frame->locals[index];
+                Value b = CONSTANT(READ_BYTE());
+
+                if (!ValueIsInt(a) || ValueIntAdd(a, b, &frame->locals[index])) {
+                    SLOW_BIN_OP(Add, a, b, frame->locals[index]);
+                }
+
+                DISPATCH();
+            }
+
+            VM_CASE(LessJumpIfFalse): {
+                READ_OPERAND(LessJumpIfFalse, READ_SHORT());
+                Value b = POP();
+                Value a = POP();
+                Value result;
+
+                if (ValueIsInt(a) && ValueIsInt(b)) {
+                    result = ValueBool(ValueAsInt(a) < ValueAsInt(b));
+                } else {
+                    SLOW_BIN_OP(Less, a, b, result);
+                }
+
+                if (ValueIsFalse(result)) {
+                    ip += operand;
+                }
+
+                DISPATCH();
+            }
+
+            VM_CASE(LessLocalConstJumpIfFalse): {
+                READ_OPERAND(LessLocalConstJumpIfFalse, READ_SHORT());
+                Value a = frame->locals[READ_BYTE()];
+                Value b = CONSTANT(READ_BYTE());
+                Value result;
+
+                if (ValueIsInt(a)) {
+                    result = ValueBool(ValueAsInt(a) < ValueAsInt(b));
+                } else {
+                    SLOW_BIN_OP(Less, a, b, result);
+                }
+
+                if (ValueIsFalse(result)) {
+                    ip += operand;
+                }
+
+                DISPATCH();
             }
 
-#define BIN_OP(self, op) \
-                case Opcode_##op: \
-                    TRY(BinOp(self, BinaryOp_##op)); \
-                    break;
-            BIN_OP(self, Add);
-            BIN_OP(self, Subtract);
-            BIN_OP(self, Multiply);
-            BIN_OP(self, Divide);
-            BIN_OP(self, Greater);
-            BIN_OP(self, Less);
+#undef SLOW_BIN_OP
 
-            case Opcode_Equal: {
+            VM_CASE(Equal): {
                 // TODO: Objects custom equality.
-                Value b = StackPop(self);
-                Value a = StackPeek(self);
-                StackPeekSet(self, ValueBool(ValueAreEqual(a, b)));
-                break;
+                Value b = POP();
+                Value a = PEEK();
+                PEEK() = ValueBool(ValueAreEqual(a, b));
+                DISPATCH();
             }
 
-                // Code duplication...
+            VM_CASE(NotEqual): {
+                Value b = POP();
+                Value a = PEEK();
+                PEEK() = ValueBool(!ValueAreEqual(a, b));
+                DISPATCH();
+            }
 
-#define JUMP_COND(self, frame, opcode, op, bool, mode) \
-                do \
+#define JUMP_COND(name, bool, mode) \
+            VM_CASE(name): { \
+                READ_OPERAND(name, READ_SHORT()); \
+                if (ValueIs##bool(mode())) \
                 { \
-                    uint16_t offset = ReadShort(frame); \
-                    if (ValueIs##bool(Stack##mode(self))) \
-                    { \
-                        frame->ip op##= offset; \
-                    } \
-                } while (false)
-
-            case Opcode_JumpIfFalse:
-                JUMP_COND(self, frame, opcode, +, False, Peek);
-                break;
+                    ip += operand; \
+                } \
+                DISPATCH(); \
+            }
 
-            case Opcode_JumpIfFalsePop:
-                JUMP_COND(self, frame, opcode, +, False, Pop);
-                break;
+            JUMP_COND(JumpIfFalse, False, PEEK)
+            JUMP_COND(JumpIfFalsePop, False, POP)
+            JUMP_COND(JumpIfTrue, True, PEEK)
 
-            case Opcode_JumpIfTrue:
-                JUMP_COND(self, frame, opcode, +, True, Peek);
-                break;
+#undef JUMP_COND
 
-#define JUMP_UNCOND(frame, op) \
-                do \
-                { \
-                    uint16_t offset = ReadShort(frame); \
-                    frame->ip op##= offset; \
-                } while (false)
+#define JUMP_UNCOND(name, op) \
+            VM_CASE(name): { \
+                READ_OPERAND(name, READ_SHORT()); \
+                ip op##= operand; \
+                DISPATCH(); \
+            }
 
-            case Opcode_Jump:
-                JUMP_UNCOND(frame, +);
-                break;
+            JUMP_UNCOND(Jump, +)
 
-            case Opcode_Loop:
-                JUMP_UNCOND(frame, -);
-                break;
+#undef JUMP_UNCOND
+
+            VM_CASE(Loop): {
+                READ_OPERAND(Loop, READ_SHORT());
+                ip -= operand;
+                SAFEPOINT();
+                JIT_ENTER();
+                DISPATCH();
+            }
 
-            case Opcode_Print: {
+            VM_CASE(Print): {
                 // TODO: Objects custom printing.
-                Value value = StackPeek(self);
+                Value value = POP();
                 ValuePrint(value, USER_OUT);
                 fprintf(USER_OUT, "\n");
-                StackPop(self);
-                break;
+                DISPATCH();
             }
 
-            case Opcode_Pop: {
-                StackPop(self);
-                break;
+            VM_CASE(Pop): {
+                (void) POP();
+                DISPATCH();
             }
 
-            case Opcode_GetGlobal: {
-                uint8_t arg = ReadByte(frame);
-                Value value = GetGlobal(frame, arg);
-                StackPush(self, value);
-                break;
+            VM_CASE(GetGlobal): {
+                READ_OPERAND(GetGlobal, READ_BYTE());
+                PUSH(GetGlobal(frame, operand));
+                DISPATCH();
             }
 
-            case Opcode_SetGlobal: {
-                uint8_t arg = ReadByte(frame);
-                Value value = StackPeek(self);
-                SetGlobal(frame, arg, value);
-                break;
+            VM_CASE(SetGlobal): {
+                READ_OPERAND(SetGlobal, READ_BYTE());
+                SetGlobal(self, frame, operand, PEEK());
+                DISPATCH();
             }
 
-            case Opcode_GetLocal: {
-                uint8_t slot = ReadByte(frame);
-                StackPush(self, frame->locals[slot]);
-                break;
+            VM_CASE(SetGlobalPop): {
+                READ_OPERAND(SetGlobalPop, READ_BYTE());
+                SetGlobal(self, frame, operand, PEEK());
+                (void) POP();
+                DISPATCH();
             }
 
-            case Opcode_SetLocal: {
-                uint8_t slot = ReadByte(frame);
-                frame->locals[slot] = StackPeek(self);
-                break;
+            VM_CASE(GetLocal): {
+                READ_OPERAND(GetLocal, READ_BYTE());
+                PUSH(frame->locals[operand]);
+                DISPATCH();
             }
 
-#define CALL_LIKE_OP(self, frame, op) \
-                case Opcode_##op: \
-                    { \
-                        uint8_t arg_count = ReadByte(frame); \
-                        Value function = StackPeekAt(self, arg_count); \
-                        \
-                        TRY(op(self, function, arg_count)); \
-                        break; \
-                    }
+            VM_CASE(SetLocal): {
+                READ_OPERAND(SetLocal, READ_BYTE());
+                frame->locals[operand] = PEEK();
+                DISPATCH();
+            }
+
+            VM_CASE(SetLocalPop): {
+                READ_OPERAND(SetLocalPop, READ_BYTE());
+                frame->locals[operand] = POP();
+                DISPATCH();
+            }
+
+#define CALL_LIKE_OP(self, op) \
+            VM_CASE(op): { \
+                uint8_t arg_count = READ_BYTE(); \
+                Value function = PEEK_AT(arg_count); \
+                \
+                STORE_REGISTERS(); \
+                TRY(op(self, function, arg_count)); \
+                LOAD_REGISTERS(); \
+                SAFEPOINT(); \
+                JIT_ENTER(); \
+                DISPATCH(); \
+            }
+
+            CALL_LIKE_OP(self, Call)
+            CALL_LIKE_OP(self, GetItem)
+            CALL_LIKE_OP(self, SetItem)
+
+#undef CALL_LIKE_OP
+
+            VM_CASE(Invoke): {
+                READ_OPERAND(Invoke, READ_BYTE());
+                uint8_t arg_count = READ_BYTE();
+
+                STORE_REGISTERS();
+                TRY(Invoke(self, frame->function, operand, arg_count));
+                LOAD_REGISTERS();
+                SAFEPOINT();
+                JIT_ENTER();
+                DISPATCH();
+            }
+
+            VM_CASE(InstanceOf): {
+                Value klass = POP();
+                Value value = PEEK();
+
+                CHECK_VALUE_OBJECT_TYPE(self, klass, Class);
 
-            CALL_LIKE_OP(self, frame, Call);
-            CALL_LIKE_OP(self, frame, GetItem);
-            CALL_LIKE_OP(self, frame, SetItem);
+                PEEK() = ValueBool(IsInstanceOf(value, ObjectAsClass(ValueAsObject(klass))));
+                DISPATCH();
+            }
 
-            case Opcode_Return: {
+            VM_CASE(Return): {
                 // TODO: uhm, probably bug with the first script that is very last at the end.
 
-                Value value = StackPop(self);
+                Value value = POP();
 
+                STORE_REGISTERS();
                 TRY(PopFrame(self));
 
                 if (self->frame_ptr == self->frames) {
                     return Error_None;
                 }
 
-                StackPush(self, value);
+                LOAD_REGISTERS();
+                PUSH(value);
+                SAFEPOINT();
+                JIT_ENTER();
 
-                break;
+                DISPATCH();
             }
 
-            case Opcode_Export: {
-                Value value = StackPeek(self);
-                Value key = ReadConstant(frame);
+            VM_CASE(Export): {
+                READ_OPERAND(Export, READ_BYTE());
+                Value value = PEEK();
+                Value key = CONSTANT(operand);
 
+                STORE_REGISTERS();
                 if (!HashTablePut(GetExports(frame), self, key, value)) {
                     fprintf(USER_ERR,
                             "error: variable reexport: '%s'\n",
@@ -458,20 +863,25 @@ Error Run(VirtualMachine *self) {
                     return Error_VariableRedefinition;
                 }
 
-                StackPop(self);
+                MemoryManagerWriteBarrier(&self->memory_manager, (Object *) GetModule(frame));
 
-                break;
+                (void) POP();
+
+                DISPATCH();
             }
 
-            case Opcode_Import: {
+            VM_CASE(Import): {
                 // TODO: BUG in compiler first statement is import wrong line number.
                 // TODO: Or maybe there.
 
-                Value key = ReadConstant(frame);
+                READ_OPERAND(Import, READ_BYTE());
+                Value key = CONSTANT(operand);
                 ObjectString *str = ObjectAsString(ValueAsObject(key));
 
                 ObjectModule *module = NULL;
 
+                STORE_REGISTERS();
+
                 self->memory_manager.on = false;
                 TRY(VirtualMachineLoadModule(self, frame->function->module->parent_dir, str, &module));
                 self->memory_manager.on = true;
@@ -485,120 +895,170 @@ Error Run(VirtualMachine *self) {
                     return Error_CircularImport;
                 }
 
-                break;
+                LOAD_REGISTERS();
+
+                // A script leaves its module on the stack at ModuleEnd, one that already ran is pushed here.
+                if (module->state == ObjectModuleState_ScriptExecuted) {
+                    PUSH(ValueObject((Object *) module));
+                }
+
+                DISPATCH();
             }
 
-            case Opcode_Top: // TODO: Delete? I don't use it, probably.
+            VM_CASE(Top): // TODO: Delete? I don't use it, probably.
             {
-                StackPush(self, StackPeek(self));
-                break;
+                Value value = PEEK();
+                PUSH(value);
+                DISPATCH();
             }
 
-            case Opcode_GetAttribute: {
-                Value attr = ReadConstant(frame);
-                Value from = StackPeek(self);
+            VM_CASE(GetAttribute): {
+                READ_OPERAND(GetAttribute, READ_BYTE());
+                Value from = PEEK();
 
-                TRY(GetAttribute(self, from, attr));
+                if (ValueIsObject(from) && ValueAsObject(from)->type == ObjectType_Instance) {
+                    ObjectInstance *instance = (ObjectInstance *) ValueAsObject(from);
+                    const InlineCacheEntry *entry = InlineCacheFindGet(
+                            ChunkFindCache(&frame->function->chunk, operand), instance->shape, instance->klass);
 
-                break;
+                    if (entry != NULL && entry->kind == InlineCacheKind_Field) {
+                        PEEK() = *ObjectInstanceSlot(instance, entry->index);
+                        DISPATCH();
+                    }
+                }
+
+                STORE_REGISTERS();
+                TRY(GetAttribute(self, from, frame->function, operand));
+                sp = self->stack_ptr;
+
+                DISPATCH();
             }
 
-            case Opcode_SetAttribute: {
-                Value key = ReadConstant(frame);
-                Value value = StackPeek(self);
-                Value instance = StackPeekAt(self, 1);
+            VM_CASE(SetAttribute): {
+                READ_OPERAND(SetAttribute, READ_BYTE());
+                Value value = PEEK();
+                Value instance = PEEK_AT(1);
+
+                if (ValueIsObject(instance) && ValueAsObject(instance)->type == ObjectType_Instance) {
+                    ObjectInstance *obj = (ObjectInstance *) ValueAsObject(instance);
+                    const InlineCacheEntry *entry = InlineCacheFindSet(
+                            ChunkFindCache(&frame->function->chunk, operand), obj->shape);
+
+                    if (entry != NULL && entry->kind == InlineCacheKind_Field) {
+                        *ObjectInstanceSlot(obj, entry->index) = value;
+                        MemoryManagerWriteBarrier(&self->memory_manager, (Object *) obj);
+                        sp -= 2;
+                        PUSH(value);
+                        DISPATCH();
+                    }
+                }
 
-                TRY(SetAttribute(self, instance, key, value));
+                STORE_REGISTERS();
+                TRY(SetAttribute(self, instance, value, frame->function, operand));
+                sp = self->stack_ptr;
 
-                break;
+                DISPATCH();
             }
 
-            case Opcode_ModuleEnd: {
+            VM_CASE(ModuleEnd): {
                 // Code duplication(
                 // Please forgive me.
 
-                StackPop(self);
+                (void) POP();
 
                 frame->function->module->state = ObjectModuleState_ScriptExecuted;
                 Value module = ValueObject((Object *) frame->function->module);
 
+                STORE_REGISTERS();
                 TRY(PopFrame(self));
 
                 if (self->frame_ptr == self->frames) {
                     return Error_None;
                 }
 
-                StackPush(self, module);
+                LOAD_REGISTERS();
+                PUSH(module);
 
-                break;
+                DISPATCH();
             }
 
-            case Opcode_BuildDictionary: {
-                uint8_t count = ReadByte(frame);
+            VM_CASE(BuildDictionary): {
+                uint8_t count = READ_BYTE();
                 assert(count % 2 == 0);
 
+                STORE_REGISTERS();
                 ObjectDictionary *obj = ObjectDictionaryNew(self);
-                StackPush(self, ValueObject((Object *) obj)); // Interesting bug.
+                PUSH(ValueObject((Object *) obj)); // Interesting bug.
+                STORE_REGISTERS();
 
                 for (int i = 0; i < count; ++i) {
-                    Value value = StackPeekAt(self, i * 2 + 1);
-                    Value key = StackPeekAt(self, i * 2 + 2);
+                    Value value = PEEK_AT(i * 2 + 1);
+                    Value key = PEEK_AT(i * 2 + 2);
                     HashTablePut(&obj->entries, self, key, value);
                 }
 
-                StackPopSeveral(self, count * 2 + 1);
+                MemoryManagerWriteBarrier(&self->memory_manager, (Object *) obj);
 
-                StackPush(self, ValueObject((Object *) obj));
+                sp -= count * 2 + 1;
 
-                break;
+                PUSH(ValueObject((Object *) obj));
+
+                DISPATCH();
             }
 
-            case Opcode_GetExport: {
-                Value key = ReadConstant(frame);
+            VM_CASE(GetExport): {
+                READ_OPERAND(GetExport, READ_BYTE());
+                Value key = CONSTANT(operand);
                 Value value;
                 if (!HashTableGet(GetExports(frame), key, &value)) {
                     fprintf(USER_ERR, "error: variable not exported: '%s'\n", ObjectAsString(ValueAsObject(key))->str);
                     return Error_UndefinedReference;
                 }
-                break;
+                DISPATCH();
             }
 
-            case Opcode_SetExport: {
-                Value key = ReadConstant(frame);
-                Value value = StackPeek(self);
+            VM_CASE(SetExport): {
+                READ_OPERAND(SetExport, READ_BYTE());
+                Value key = CONSTANT(operand);
+                Value value = PEEK();
+                STORE_REGISTERS();
                 if (!HashTablePut(GetExports(frame), self, key, value)) {
                     fprintf(USER_ERR, "error: variable not exported: '%s'\n", ObjectAsString(ValueAsObject(key))->str);
                     return Error_UndefinedReference;
                 }
-                break;
+                MemoryManagerWriteBarrier(&self->memory_manager, (Object *) GetModule(frame));
+                DISPATCH();
             }
 
-            case Opcode_GetUpvalue: {
-                uint8_t index = ReadByte(frame);
+            VM_CASE(GetUpvalue): {
+                uint8_t index = READ_BYTE();
                 assert(frame->closure);
                 assert(index < frame->closure->upvalue_count);
-                StackPush(self, *frame->closure->upvalues[index]->location);
-                break;
+                PUSH(*frame->closure->upvalues[index]->location);
+                DISPATCH();
             }
 
-            case Opcode_SetUpvalue: {
-                uint8_t index = ReadByte(frame);
+            VM_CASE(SetUpvalue): {
+                uint8_t index = READ_BYTE();
                 assert(frame->closure);
                 assert(index < frame->closure->upvalue_count);
-                *frame->closure->upvalues[index]->location = StackPeek(self);
-                break;
+                ObjectUpvalue *upvalue = frame->closure->upvalues[index];
+                *upvalue->location = PEEK();
+                MemoryManagerWriteBarrier(&self->memory_manager, (Object *) upvalue);
+                DISPATCH();
             }
 
-            case Opcode_BuildClosure: {
-                ObjectFunction *func = ObjectAsFunction(ValueAsObject(StackPeek(self)));
-                int count = ReadByte(frame);
+            VM_CASE(BuildClosure): {
+                ObjectFunction *func = ObjectAsFunction(ValueAsObject(PEEK()));
+                int count = READ_BYTE();
+
+                STORE_REGISTERS();
                 ObjectClosure *closure = ObjectClosureNew(self, func, count);
-                StackPop(self); // func is inside the closure.
-                StackPush(self, ValueObject((Object *) closure));
+                PEEK() = ValueObject((Object *) closure); // func is inside the closure.
 
                 for (int i = 0; i < count; ++i) {
-                    bool is_local = ReadByte(frame);
-                    uint8_t index = ReadByte(frame);
+                    bool is_local = READ_BYTE();
+                    uint8_t index = READ_BYTE();
 
                     if (is_local) {
                         closure->upvalues[i] = CaptureUpvalue(self, frame->locals + index);
@@ -606,37 +1066,42 @@ Error Run(VirtualMachine *self) {
                         assert(frame->closure);
                         closure->upvalues[i] = frame->closure->upvalues[index];
                     }
+
+                    // Capturing allocates, so the closure may be old by now.
+                    MemoryManagerWriteBarrier(&self->memory_manager, (Object *) closure);
                 }
 
-                break;
+                DISPATCH();
             }
 
-            case Opcode_CloseUpvalue: {
-                CloseUpvalues(self, self->stack_ptr - 1);
-                StackPop(self);
-                break;
+            VM_CASE(CloseUpvalue): {
+                CloseUpvalues(self, sp - 1);
+                (void) POP();
+                DISPATCH();
             }
 
-            case Opcode_BuildList: {
-                uint8_t count = ReadByte(frame);
+            VM_CASE(BuildList): {
+                uint8_t count = READ_BYTE();
 
+                STORE_REGISTERS();
                 ObjectList *obj = ObjectListNew(self);
-                StackPush(self, ValueObject((Object *) obj));
+                PUSH(ValueObject((Object *) obj));
+                STORE_REGISTERS();
 
                 for (int i = count - 1; i >= 0; --i) {
-                    ObjectListPush(obj, self, StackPeekAt(self, i + 1));
+                    ObjectListPush(obj, self, PEEK_AT(i + 1));
                 }
 
-                StackPopSeveral(self, count + 1);
+                sp -= count + 1;
 
-                StackPush(self, ValueObject((Object *) obj));
+                PUSH(ValueObject((Object *) obj));
 
-                break;
+                DISPATCH();
             }
 
-            case Opcode_Inherit: {
-                Value parent = StackPeek(self);
-                Value child = StackPeekAt(self, 1);
+            VM_CASE(Inherit): {
+                Value parent = PEEK();
+                Value child = PEEK_AT(1);
 
                 CHECK_VALUE_OBJECT_TYPE(self, parent, Class);
                 CHECK_VALUE_OBJECT_TYPE(self, child, Class);
@@ -644,16 +1109,19 @@ Error Run(VirtualMachine *self) {
                 ObjectClass *parent_class = ObjectAsClass(ValueAsObject(parent));
                 ObjectClass *child_class = ObjectAsClass(ValueAsObject(child));
 
+                STORE_REGISTERS();
                 child_class->super = parent_class;
                 HashTableAddAll(&child_class->methods, self, &parent_class->methods);
+                MemoryManagerWriteBarrier(&self->memory_manager, (Object *) child_class);
 
-                StackPop(self);
+                (void) POP();
 
-                break;
+                DISPATCH();
             }
 
-            case Opcode_SuperGet: {
-                Value name = ReadConstant(frame);
+            VM_CASE(SuperGet): {
+                READ_OPERAND(SuperGet, READ_BYTE());
+                Value name = CONSTANT(operand);
                 Value instance = frame->locals[0];
 
                 CHECK_VALUE_OBJECT_TYPE(self, instance, Instance);
@@ -675,100 +1143,142 @@ Error Run(VirtualMachine *self) {
                 // TODO: Bound method fields. Value maybe?
                 // TODO: ObjectAsFunction should apply (or not) a closure. Oh, actually methods can't be closures.
 
+                STORE_REGISTERS();
                 ObjectBoundMethod *bound_method = ObjectBoundMethodNew(self, instance_obj,
                                                                        ObjectAsFunction(ValueAsObject(method)));
 
-                StackPush(self, ValueObject((Object *) bound_method));
+                PUSH(ValueObject((Object *) bound_method));
 
-                break;
+                DISPATCH();
             }
 
-            case Opcode_TryBegin:
-            {
-                uint16_t jump = ReadShort(frame);
+            VM_CASE(TryBegin): {
+                READ_OPERAND(TryBegin, READ_SHORT());
 
-                if (self->handler_ptr - self->handlers >= VM_HANDLERS_COUNT) {
-                    fprintf(USER_ERR, "error: too many catch handlers\n");
-                    return Error_StackOverflow;
+                if (self->handler_ptr == self->handlers_end) {
+                    TRY(GrowHandlers(self));
                 }
 
                 CatchHandler *handler = self->handler_ptr++;
-                handler->frame = frame;
-                handler->ip = frame->ip + jump;
-                handler->stack_ptr = self->stack_ptr;
-                handler->open_upvalues = self->open_upvalues;
+                handler->frame = frame - self->frames;
+                handler->ip = ip + operand;
+                handler->stack_size = sp - self->stack;
 
-                break;
+                DISPATCH();
             }
 
-            case Opcode_TryEnd:
-            {
+            VM_CASE(TryEnd): {
                 assert(self->handler_ptr != self->handlers);
                 --self->handler_ptr;
-                break;
+                DISPATCH();
             }
 
-            case Opcode_Throw:
-            {
-                Value value = StackPop(self);
+            VM_CASE(Throw): {
+                Value value = POP();
 
                 if (self->handler_ptr == self->handlers) {
                     fprintf(USER_ERR, "error: unhandled exception\n");
                     return Error_UnhandledException;
                 }
 
-                CatchHandler* handler = --self->handler_ptr;
-                frame = handler->frame;
-                frame->ip = handler->ip;
-                self->stack_ptr = handler->stack_ptr;
-                self->open_upvalues = handler->open_upvalues;
-                StackPush(self, value);
+                // The handler may belong to one of the callers, so the frames above it are dropped.
+                CatchHandler *handler = --self->handler_ptr;
+                self->frame_ptr = self->frames + handler->frame + 1;
+                self->frames[handler->frame].ip = handler->ip;
+                self->stack_ptr = self->stack + handler->stack_size;
+                CloseUpvalues(self, self->stack_ptr);
 
-                break;
+                LOAD_REGISTERS();
+                PUSH(value);
+
+                DISPATCH();
+            }
+
+            VM_CASE(Wide): {
+                switch (READ_BYTE()) {
+#define WIDE_CASE(name, width) \
+                    case Opcode_##name: \
+                        operand = READ_##width(); \
+                        goto Wide_##name;
+
+                    Opcode_WIDE_LIST(WIDE_CASE)
+
+#undef WIDE_CASE
+
+                    default:
+                        fprintf(USER_ERR, "FATAL ERROR: unknown wide opcode: 0x%02x\n", ip[-1]);
+                        return Error_UnknownOpcode;
+                }
             }
 
-            default:
+#ifdef VM_COMPUTED_GOTO
+
+            Label_Instrumented: {
+                INSTRUMENT();
+                goto *dispatch_table[opcode];
+            }
+
+#endif
+
+            VM_DEFAULT: {
                 fprintf(USER_ERR, "FATAL ERROR: unknown opcode: 0x%02x\n", opcode);
                 return Error_UnknownOpcode;
+            }
         }
     }
 }
 
-static ObjectUpvalue *CaptureUpvalue(VirtualMachine *self, Value *location) {
-    // TODO: Sort linked list.
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef DISPATCH
+#undef TRACE_INSTRUCTION
+#undef INSTRUMENT
+#undef SAFEPOINT
+#undef PUSH
+#undef POP
+#undef PEEK
+#undef PEEK_AT
+#undef CONSTANT
+#undef READ_OPERAND
+#undef READ_LONG
+#undef READ_SHORT
+#undef READ_BYTE
+#undef LOAD_REGISTERS
+#undef STORE_REGISTERS
 
+static ObjectUpvalue *CaptureUpvalue(VirtualMachine *self, Value *location) {
+    ObjectUpvalue *prev = NULL;
     ObjectUpvalue *current = self->open_upvalues;
-    while (current && current->location != location) {
+    while (current && current->location > location) {
+        prev = current;
         current = current->next;
     }
 
-    if (current) {
+    if (current && current->location == location) {
         return current;
     }
 
-    ObjectUpvalue *upvalue = ObjectUpvalueNew(self, location, self->open_upvalues);
-    self->open_upvalues = upvalue;
+    ObjectUpvalue *upvalue = ObjectUpvalueNew(self, location, current);
+
+    if (prev) {
+        prev->next = upvalue;
+    } else {
+        self->open_upvalues = upvalue;
+    }
+
     return upvalue;
 }
 
+// Only the head of the list is looked at, the upvalues above last are all in front.
 static void CloseUpvalues(VirtualMachine *self, Value *last) {
-    ObjectUpvalue *prev = NULL;
-    ObjectUpvalue *cur = self->open_upvalues;
-    while (cur) {
-        if (cur->location >= last) {
-            cur->closed = *cur->location;
-            cur->location = &cur->closed;
-
-            if (prev) {
-                prev->next = cur->next;
-            } else {
-                self->open_upvalues = cur->next;
-            }
-        } else {
-            prev = cur;
-        }
-
-        cur = cur->next;
+    while (self->open_upvalues && self->open_upvalues->location >= last) {
+        ObjectUpvalue *cur = self->open_upvalues;
+        cur->closed = *cur->location;
+        cur->location = &cur->closed;
+        MemoryManagerWriteBarrier(&self->memory_manager, (Object *) cur);
+
+        self->open_upvalues = cur->next;
+        cur->next = NULL;
     }
 }
 
@@ -779,17 +1289,25 @@ static Error PushScript(VirtualMachine *self, ObjectFunction *script) {
 }
 
 static Error PushFrame(VirtualMachine *self, ObjectFunction *function, ObjectClosure *closure) {
-    if (self->frame_ptr - self->frames == VM_FRAMES_COUNT) {
-        // TODO: ERROR?
-        return Error_StackOverflow;
+    if (self->frame_ptr == self->frames_end) {
+        TRY(GrowFrames(self));
+    }
+
+    const size_t needed = function->chunk.stack_size + VM_STACK_SIZE_PER_FRAME;
+    if ((size_t) (self->stack_end - self->stack_ptr) < needed) {
+        TRY(GrowStack(self, needed));
     }
 
-    CallFrame *frame = self->frame_ptr++;
+    CallFrame *frame = self->frame_ptr;
     frame->function = function;
     frame->closure = closure;
     frame->ip = function->chunk.code;
     frame->locals = self->stack_ptr - function->arity - 1;
 
+    // The sampler's signal handler must not see the frame before it is filled.
+    atomic_signal_fence(memory_order_release);
+    ++self->frame_ptr;
+
     return Error_None;
 }
 
@@ -808,16 +1326,85 @@ static Error PopFrame(VirtualMachine *self) {
     return Error_None;
 }
 
+// Values are copied to a new block, so the frames and the open upvalues still point to
+// the old one while they are moved over. Run() reloads its registers after every call.
+static Error GrowStack(VirtualMachine *self, size_t needed) {
+    size_t size = self->stack_ptr - self->stack;
+    size_t capacity = (self->stack_end - self->stack) * 2;
+    while (capacity - size < needed) {
+        capacity *= 2;
+    }
+
+    if (capacity > VM_STACK_MAX_SIZE) {
+        fprintf(USER_ERR, "error: stack overflow\n");
+        return Error_StackOverflow;
+    }
+
+    Value *stack = AllocateStack(NULL, sizeof(Value) * capacity);
+    memcpy(stack, self->stack, sizeof(Value) * size);
+
+    for (CallFrame *frame = self->frames; frame != self->frame_ptr; ++frame) {
+        frame->locals = stack + (frame->locals - self->stack);
+    }
+
+    for (ObjectUpvalue *upvalue = self->open_upvalues; upvalue != NULL; upvalue = upvalue->next) {
+        upvalue->location = stack + (upvalue->location - self->stack);
+    }
+
+    free(self->stack);
+    self->stack = stack;
+    self->stack_ptr = stack + size;
+    self->stack_end = stack + capacity;
+
+    return Error_None;
+}
+
+static Error GrowFrames(VirtualMachine *self) {
+    size_t count = self->frame_ptr - self->frames;
+    size_t capacity = (self->frames_end - self->frames) * 2;
+
+    if (capacity > VM_FRAMES_MAX_COUNT) {
+        fprintf(USER_ERR, "error: stack overflow\n");
+        return Error_StackOverflow;
+    }
+
+    if (self->sampler != NULL) {
+        SamplerPause(self->sampler);
+    }
+
+    self->frames = AllocateStack(self->frames, sizeof(CallFrame) * capacity);
+    self->frame_ptr = self->frames + count;
+    self->frames_end = self->frames + capacity;
+
+    if (self->sampler != NULL) {
+        SamplerResume(self->sampler);
+    }
+
+    return Error_None;
+}
+
+static Error GrowHandlers(VirtualMachine *self) {
+    size_t count = self->handler_ptr - self->handlers;
+    size_t capacity = (self->handlers_end - self->handlers) * 2;
+
+    if (capacity > VM_HANDLERS_MAX_COUNT) {
+        fprintf(USER_ERR, "error: too many catch handlers\n");
+        return Error_StackOverflow;
+    }
+
+    self->handlers = AllocateStack(self->handlers, sizeof(CatchHandler) * capacity);
+    self->handler_ptr = self->handlers + count;
+    self->handlers_end = self->handlers + capacity;
+
+    return Error_None;
+}
+
 // TODO: Asserts in stack operations.
 
 static Value StackPeek(VirtualMachine *self) {
     return self->stack_ptr[-1];
 }
 
-static void StackPeekSet(VirtualMachine *self, Value value) {
-    self->stack_ptr[-1] = value;
-}
-
 static Value StackPeekAt(VirtualMachine *self, size_t offset) {
     return self->stack_ptr[-1 - offset];
 }
@@ -826,12 +1413,6 @@ static Value StackPop(VirtualMachine *self) {
     return *--self->stack_ptr;
 }
 
-static void StackPopSeveral(VirtualMachine *self, size_t count) {
-    for (size_t i = 0; i < count; ++i) {
-        StackPop(self);
-    }
-}
-
 static void StackPush(VirtualMachine *self, Value value) {
     *self->stack_ptr++ = value;
 }
@@ -849,32 +1430,16 @@ static Value GetGlobal(CallFrame *frame, size_t arg) {
     return GetModule(frame)->globals[arg];
 }
 
-static void SetGlobal(CallFrame *frame, size_t arg, Value value) {
+static void SetGlobal(VirtualMachine *self, CallFrame *frame, size_t arg, Value value) {
     assert(arg < GetModule(frame)->globals_count);
     GetModule(frame)->globals[arg] = value;
+    MemoryManagerWriteBarrier(&self->memory_manager, (Object *) GetModule(frame));
 }
 
 static HashTable *GetExports(CallFrame *frame) {
     return &frame->function->module->exports;
 }
 
-static uint8_t ReadByte(CallFrame *frame) {
-    assert(frame->ip != frame->function->chunk.code + frame->function->chunk.code_length);
-    return *(frame->ip++);
-}
-
-static uint16_t ReadShort(CallFrame *frame) {
-    uint16_t part_1 = ReadByte(frame);
-    uint16_t part_2 = ReadByte(frame);
-    return (part_2 << 8) | part_1;
-}
-
-static Value ReadConstant(CallFrame *frame) {
-    uint8_t index = ReadByte(frame);
-    assert(index < frame->function->chunk.constants_length);
-    return frame->function->chunk.constants[index];
-}
-
 static void TraceStack(VirtualMachine *self) {
     FILE *out = DEBUG_OUT;
 
@@ -895,34 +1460,53 @@ static Error BinOp(VirtualMachine *self, BinaryOp op) {
     CHECK_VALUE_TYPE(self, a, Int);
     CHECK_VALUE_TYPE(self, b, Int);
 
-    int rhs = ValueAsInt(b);
-    int lhs = ValueAsInt(a);
+    int64_t rhs = ValueAsInt(b);
+    int64_t lhs = ValueAsInt(a);
+
+    Value result;
+    bool overflow = false;
 
     switch (op) {
         case BinaryOp_Add:
-            StackPush(self, ValueInt(lhs + rhs));
+            overflow = ValueIntAdd(a, b, &result);
             break;
         case BinaryOp_Subtract:
-            StackPush(self, ValueInt(lhs - rhs));
+            overflow = ValueIntSubtract(a, b, &result);
             break;
         case BinaryOp_Multiply:
-            StackPush(self, ValueInt(lhs * rhs));
+            overflow = ValueIntMultiply(a, b, &result);
             break;
         case BinaryOp_Divide:
             if (rhs == 0) {
                 fprintf(USER_ERR, "error: zero division\n");
                 return Error_ZeroDivision;
             }
-            StackPush(self, ValueInt(lhs / rhs));
+            if (lhs == VALUE_INT_MIN && rhs == -1) {
+                overflow = true;
+                break;
+            }
+            result = ValueInt(lhs / rhs);
             break;
         case BinaryOp_Greater:
             StackPush(self, ValueBool(lhs > rhs));
-            break;
+            return Error_None;
         case BinaryOp_Less:
             StackPush(self, ValueBool(lhs < rhs));
-            break;
+            return Error_None;
+        case BinaryOp_LessEqual:
+            StackPush(self, ValueBool(lhs <= rhs));
+            return Error_None;
+        case BinaryOp_GreaterEqual:
+            StackPush(self, ValueBool(lhs >= rhs));
+            return Error_None;
+    }
+
+    if (overflow) {
+        fprintf(USER_ERR, "error: integer overflow\n");
+        return Error_IntegerOverflow;
     }
 
+    StackPush(self, result);
     return Error_None;
 }
 
@@ -1002,27 +1586,65 @@ static Error Call(VirtualMachine *self, Value value, uint8_t arity) {
     return Error_None;
 }
 
-static Error GetObjectAttribute(VirtualMachine *self, Object *obj, Value key);
+static Error GetObjectAttribute(VirtualMachine *self, Object *obj, ObjectFunction *function, uint16_t constant,
+                                Value *res);
 
-static Error GetAttribute(VirtualMachine *self, Value from, Value attr) {
+static Error GetAttribute(VirtualMachine *self, Value from, ObjectFunction *function, uint16_t constant) {
     switch (ValueGetType(from)) {
-        case ValueType_Object:
-            return GetObjectAttribute(self, ValueAsObject(from), attr);
+        case ValueType_Object: {
+            Value res;
+            TRY(GetObjectAttribute(self, ValueAsObject(from), function, constant, &res));
+            StackPop(self);
+            StackPush(self, res);
+            return Error_None;
+        }
         default:
             fprintf(USER_ERR, "error: cannot get attribute from %s\n", ValueTypeToString(ValueGetType(from)));
             return Error_TypeMismatch;
     }
 }
 
-static Error GetObjectAttribute(VirtualMachine *self, Object *obj, Value key) {
+// The instruction's cache is filled there, the hit on a field is handled in Run.
+static Error FindInstanceAttribute(VirtualMachine *self, ObjectInstance *instance, ObjectFunction *function,
+                                   uint16_t constant, const InlineCacheEntry **ptr) {
+    InlineCache *cache = ChunkGetCache(&function->chunk, self, constant);
+    const InlineCacheEntry *entry = InlineCacheFindGet(cache, instance->shape, instance->klass);
+
+    if (entry == NULL) {
+        Value key = function->chunk.constants[constant];
+        InlineCacheEntry miss = {.shape = instance->shape, .klass = instance->klass};
+        int index = ObjectShapeFind(instance->shape, key);
+        Value method;
+
+        if (index >= 0) {
+            miss.kind = InlineCacheKind_Field;
+            miss.index = index;
+        } else if (HashTableGet(&instance->klass->methods, key, &method)) {
+            assert(ObjectIsFunction(ValueAsObject(method)));
+            miss.kind = InlineCacheKind_Method;
+            miss.method = ObjectAsFunction(ValueAsObject(method));
+        } else {
+            fprintf(USER_ERR, "error: undefined attribute: '%s'\n", ObjectAsString(ValueAsObject(key))->str);
+            return Error_UndefinedReference;
+        }
+
+        InlineCacheAdd(cache, miss);
+        MemoryManagerWriteBarrier(&self->memory_manager, (Object *) function);
+        entry = InlineCacheFindGet(cache, instance->shape, instance->klass);
+    }
+
+    *ptr = entry;
+    return Error_None;
+}
+
+static Error GetObjectAttribute(VirtualMachine *self, Object *obj, ObjectFunction *function, uint16_t constant,
+                                Value *res) {
     switch (ObjectGetType(obj)) {
         case ObjectType_Module: {
             ObjectModule *module = ObjectAsModule(obj);
+            Value key = function->chunk.constants[constant];
 
-            Value value;
-            if (HashTableGet(&module->exports, key, &value)) {
-                StackPop(self);
-                StackPush(self, value);
+            if (HashTableGet(&module->exports, key, res)) {
                 return Error_None;
             }
 
@@ -1032,26 +1654,16 @@ static Error GetObjectAttribute(VirtualMachine *self, Object *obj, Value key) {
 
         case ObjectType_Instance: {
             ObjectInstance *instance = ObjectAsInstance(obj);
-            Value value;
-
-            if (HashTableGet(&instance->fields, key, &value)) {
-                StackPop(self);
-                StackPush(self, value);
-                return Error_None;
-            }
+            const InlineCacheEntry *entry = NULL;
+            TRY(FindInstanceAttribute(self, instance, function, constant, &entry));
 
-            if (HashTableGet(&instance->klass->methods, key, &value)) {
-                assert(ObjectIsFunction(ValueAsObject(value)));
-                ObjectBoundMethod *bound = ObjectBoundMethodNew(self,
-                                                                instance,
-                                                                ObjectAsFunction(ValueAsObject(value)));
-                StackPop(self);
-                StackPush(self, ValueObject((Object *) bound));
-                return Error_None;
+            if (entry->kind == InlineCacheKind_Field) {
+                *res = *ObjectInstanceSlot(instance, entry->index);
+            } else {
+                *res = ValueObject((Object *) ObjectBoundMethodNew(self, instance, entry->method));
             }
 
-            fprintf(USER_ERR, "error: undefined attribute: '%s'\n", ObjectAsString(ValueAsObject(key))->str);
-            return Error_UndefinedReference;
+            return Error_None;
         }
 
         default:
@@ -1060,19 +1672,63 @@ static Error GetObjectAttribute(VirtualMachine *self, Object *obj, Value key) {
     }
 }
 
-static Error SetObjectAttribute(VirtualMachine *self, Object *instance, Value key, Value value);
+// obj.name(args) without the bound method, the receiver is already in slot 0.
+static Error Invoke(VirtualMachine *self, ObjectFunction *function, uint16_t constant, uint8_t arity) {
+    Value receiver = StackPeekAt(self, arity);
+
+    if (!ValueIsObject(receiver)) {
+        fprintf(USER_ERR, "error: cannot get attribute from %s\n", ValueTypeToString(ValueGetType(receiver)));
+        return Error_TypeMismatch;
+    }
+
+    Object *obj = ValueAsObject(receiver);
+
+    if (ObjectIsInstance(obj)) {
+        const InlineCacheEntry *entry = NULL;
+        TRY(FindInstanceAttribute(self, ObjectAsInstance(obj), function, constant, &entry));
+
+        if (entry->kind == InlineCacheKind_Method) {
+            return Call(self, ValueObject((Object *) entry->method), arity);
+        }
+    }
+
+    Value callee;
+    TRY(GetObjectAttribute(self, obj, function, constant, &callee));
+    self->stack_ptr[-arity - 1] = callee;
+
+    return Call(self, callee, arity);
+}
+
+static bool IsInstanceOf(Value value, ObjectClass *klass) {
+    if (!ValueIsObject(value) || !ObjectIsInstance(ValueAsObject(value))) {
+        return false;
+    }
+
+    for (ObjectClass *current = ObjectAsInstance(ValueAsObject(value))->klass; current != NULL; current = current->super) {
+        if (current == klass) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static Error SetObjectAttribute(VirtualMachine *self, Object *instance, Value value,
+                                ObjectFunction *function, uint16_t constant);
 
-static Error SetAttribute(VirtualMachine *self, Value instance, Value key, Value value) {
+static Error SetAttribute(VirtualMachine *self, Value instance, Value value, ObjectFunction *function,
+                          uint16_t constant) {
     switch (ValueGetType(instance)) {
         case ValueType_Object:
-            return SetObjectAttribute(self, ValueAsObject(instance), key, value);
+            return SetObjectAttribute(self, ValueAsObject(instance), value, function, constant);
         default:
             fprintf(USER_ERR, "error: cannot set attribute for %s\n", ValueTypeToString(ValueGetType(instance)));
             return Error_TypeMismatch;
     }
 }
 
-static Error SetObjectAttribute(VirtualMachine *self, Object *instance, Value key, Value value) {
+static Error SetObjectAttribute(VirtualMachine *self, Object *instance, Value value,
+                                ObjectFunction *function, uint16_t constant) {
     if (!ObjectIsInstance(instance)) {
         fprintf(USER_ERR, "error: expected Instance, got %s\n",
                 ObjectTypeToString(ObjectGetType(instance)));
@@ -1080,8 +1736,35 @@ static Error SetObjectAttribute(VirtualMachine *self, Object *instance, Value ke
     }
 
     ObjectInstance *obj = ObjectAsInstance(instance);
+    InlineCache *cache = ChunkGetCache(&function->chunk, self, constant);
+    const InlineCacheEntry *entry = InlineCacheFindSet(cache, obj->shape);
+
+    if (entry == NULL) {
+        Value key = function->chunk.constants[constant];
+        InlineCacheEntry miss = {.shape = obj->shape, .klass = obj->klass};
+        int index = ObjectShapeFind(obj->shape, key);
+
+        if (index >= 0) {
+            miss.kind = InlineCacheKind_Field;
+            miss.index = index;
+        } else {
+            miss.kind = InlineCacheKind_Transition;
+            miss.new_shape = ObjectShapeTransition(obj->shape, self, key);
+            miss.index = obj->shape->count;
+        }
+
+        InlineCacheAdd(cache, miss);
+        MemoryManagerWriteBarrier(&self->memory_manager, (Object *) function);
+        entry = InlineCacheFindSet(cache, obj->shape);
+    }
+
+    if (entry->kind == InlineCacheKind_Field) {
+        *ObjectInstanceSlot(obj, entry->index) = value;
+        MemoryManagerWriteBarrier(&self->memory_manager, (Object *) obj);
+    } else {
+        ObjectInstanceAddField(obj, self, entry->new_shape, value);
+    }
 
-    HashTablePut(&obj->fields, self, key, value);
     StackPop(self); // value
     StackPop(self); // instance
     StackPush(self, value);
@@ -1111,7 +1794,7 @@ static Error GetItem(VirtualMachine *self, Value value, uint8_t arity) {
 
             CHECK_VALUE_TYPE(self, arg, Int);
 
-            int index = ValueAsInt(arg);
+            int64_t index = ValueAsInt(arg);
             if (index < 0 || index >= str->length) {
                 fprintf(USER_ERR, "error: index out of range\n");
                 return Error_OutOfRange;
@@ -1139,7 +1822,7 @@ static Error GetItem(VirtualMachine *self, Value value, uint8_t arity) {
 
             CHECK_VALUE_TYPE(self, arg, Int);
 
-            int index = ValueAsInt(arg);
+            int64_t index = ValueAsInt(arg);
             if (index < 0 || index >= list->count) {
                 fprintf(USER_ERR, "error: index out of range\n");
                 return Error_OutOfRange;
@@ -1184,6 +1867,7 @@ static Error SetItem(VirtualMachine *self, Value value, uint8_t arity) {
             ObjectDictionary *dictionary = ObjectAsDictionary(obj);
 
             HashTablePut(&dictionary->entries, self, arg, assign);
+            MemoryManagerWriteBarrier(&self->memory_manager, (Object *) dictionary);
             break;
         }
 
@@ -1192,13 +1876,14 @@ static Error SetItem(VirtualMachine *self, Value value, uint8_t arity) {
 
             CHECK_VALUE_TYPE(self, arg, Int);
 
-            int index = ValueAsInt(arg);
+            int64_t index = ValueAsInt(arg);
             if (index < 0 || index >= list->count) {
                 fprintf(USER_ERR, "error: index out of range\n");
                 return Error_OutOfRange;
             }
 
             list->elements[index] = assign;
+            MemoryManagerWriteBarrier(&self->memory_manager, (Object *) list);
 
             break;
         }
@@ -1225,6 +1910,34 @@ void VirtualMachineMarkRoots(VirtualMachine *self, MemoryManager *memory) {
         ValueMark(*slot, memory);
     }
 
+    // A closure that captured the slot may be gone already, the list still points to the upvalue.
+    for (ObjectUpvalue *upvalue = self->open_upvalues; upvalue != NULL; upvalue = upvalue->next) {
+        ObjectMark((Object *) upvalue, memory);
+    }
+
     // ObjectMark((Object*)self->called_path, memory);
     ObjectMark((Object *) self->packages_path, memory);
+    // A module runs once, so it stays loaded even if nothing refers to it until the next import.
+    HashTableMark(&self->modules, memory);
+}
+
+void VirtualMachineRelocateRoots(VirtualMachine *self, MemoryManager *memory) {
+    CommonObjectsRelocateTraverse(&self->common, memory);
+
+    for (Value *slot = self->stack; slot != self->stack_ptr; ++slot) {
+        ValueRelocate(slot, memory);
+    }
+
+    // The callees are on the stack as well.
+    for (CallFrame *frame = self->frames; frame != self->frame_ptr; ++frame) {
+        frame->function = (ObjectFunction *) ObjectRelocate((Object *) frame->function, memory);
+        frame->closure = (ObjectClosure *) ObjectRelocateMaybeNull((Object *) frame->closure, memory);
+    }
+
+    // The rest of the list is relocated through the upvalues.
+    self->open_upvalues = (ObjectUpvalue *) ObjectRelocateMaybeNull((Object *) self->open_upvalues, memory);
+
+    self->packages_path = (ObjectString *) ObjectRelocate((Object *) self->packages_path, memory);
+    HashTableRelocate(&self->strings, memory);
+    HashTableRelocate(&self->modules, memory);
 }
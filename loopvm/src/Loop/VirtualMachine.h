@@ -6,6 +6,8 @@
 #include "MemoryManager.h"
 #include "Value.h"
 #include "HashTable.h"
+#include "OpcodeProfile.h"
+#include "Sampler.h"
 
 typedef struct CommonObjects {
     ObjectString *script;
@@ -13,10 +15,13 @@ typedef struct CommonObjects {
     ObjectString *empty_string;
     ObjectString *dot_code;
     ObjectString *compiled_dir;
+    ObjectShape *empty_shape;
 } CommonObjects;
 
 void CommonObjectsMarkTraverse(CommonObjects *self, MemoryManager *memory);
 
+void CommonObjectsRelocateTraverse(CommonObjects *self, MemoryManager *memory);
+
 // Closure may be NULL.
 typedef struct CallFrame {
     ObjectFunction *function;
@@ -25,27 +30,33 @@ typedef struct CallFrame {
     Value *locals;
 } CallFrame;
 
+// Indices instead of pointers, the stacks may be moved.
 typedef struct CatchHandler {
-    CallFrame *frame;
+    size_t frame;
     const uint8_t *ip;
-    Value *stack_ptr;
-    ObjectUpvalue *open_upvalues; // Because the list is unsorted.
+    size_t stack_size;
 } CatchHandler;
 
 typedef struct VirtualMachine {
     MemoryManager memory_manager;
     CommonObjects common;
-    Value stack[VM_STACK_SIZE_PER_FRAME * VM_FRAMES_COUNT];
+    Value *stack;
     Value *stack_ptr;
-    CallFrame frames[VM_FRAMES_COUNT];
+    Value *stack_end;
+    CallFrame *frames;
     CallFrame *frame_ptr;
-    CatchHandler handlers[VM_HANDLERS_COUNT];
+    CallFrame *frames_end;
+    CatchHandler *handlers;
     CatchHandler *handler_ptr;
-    ObjectUpvalue *open_upvalues;
+    CatchHandler *handlers_end;
+    ObjectUpvalue *open_upvalues; // Sorted by location, the top of the stack first.
     HashTable strings;
     HashTable modules;
     ObjectString *called_path;
     ObjectString *packages_path;
+    OpcodeProfile *opcode_profile; // NULL unless profiling.
+    Sampler *sampler; // NULL unless sampling.
+    bool jit; // Hot functions are compiled where the JIT is supported. Off while instrumented.
 } VirtualMachine;
 
 Error VirtualMachineInit(VirtualMachine *self);
@@ -59,4 +70,7 @@ Error VirtualMachineRunScript(VirtualMachine *self, ObjectFunction *script);
 
 void VirtualMachineMarkRoots(VirtualMachine *self, MemoryManager *memory);
 
+/// The roots of VirtualMachineMarkRoots and the objects of the frames.
+void VirtualMachineRelocateRoots(VirtualMachine *self, MemoryManager *memory);
+
 #endif // LOOP_VIRTUALMACHINE_H
@@ -1,21 +1,166 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "Loop/Object.h"
+#include "Loop/OpcodeProfile.h"
+#include "Loop/Sampler.h"
 #include "Loop/VirtualMachine.h"
 
 #include "Loop/Objects/String.h"
 #include "Loop/Objects/Module.h"
 
+// Matches `--name` and `--name=<path>`, the path stays NULL without one.
+static bool ParseOutputOption(const char* arg, const char* name, bool* enabled, const char** path)
+{
+    const size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0)
+    {
+        return false;
+    }
+
+    if (arg[length] == '\0')
+    {
+        *enabled = true;
+        return true;
+    }
+
+    if (arg[length] == '=')
+    {
+        *enabled = true;
+        *path = arg + length + 1;
+        return true;
+    }
+
+    return false;
+}
+
+// Reports go to stderr without a path.
+static FILE* OpenReport(const char* path)
+{
+    if (path == NULL)
+    {
+        return stderr;
+    }
+
+    FILE* out = fopen(path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "error: cannot open '%s' for writing\n", path);
+    }
+
+    return out;
+}
+
+static void CloseReport(FILE* out)
+{
+    if (out != NULL && out != stderr)
+    {
+        fclose(out);
+    }
+}
+
+// A path ending with .json gets the JSON report, anything else the text one.
+static void WriteOpcodeProfile(const OpcodeProfile* profile, const char* path)
+{
+    FILE* out = OpenReport(path);
+    if (out == NULL)
+    {
+        return;
+    }
+
+    const size_t length = path == NULL ? 0 : strlen(path);
+    const bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+
+    OpcodeProfileWrite(profile, out, json ? OpcodeProfileFormat_JSON : OpcodeProfileFormat_Text);
+    CloseReport(out);
+}
+
+static void WriteGCStats(const MemoryManager* memory, const char* path)
+{
+    FILE* out = OpenReport(path);
+    if (out == NULL)
+    {
+        return;
+    }
+
+    const size_t length = path == NULL ? 0 : strlen(path);
+    const bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+
+    MemoryManagerWriteStats(memory, out, json);
+    CloseReport(out);
+}
+
+static void WriteSamples(const Sampler* sampler, const char* path)
+{
+    FILE* out = OpenReport(path);
+    if (out == NULL)
+    {
+        return;
+    }
+
+    SamplerWrite(sampler, out);
+    CloseReport(out);
+}
+
 int main(int argc, const char* argv[])
 {
-    if (argc != 2)
+    const char* path = NULL;
+    bool profile_opcodes = false;
+    const char* opcode_profile_path = NULL;
+    bool profile_samples = false;
+    const char* samples_path = NULL;
+    bool gc_stats = false;
+    const char* gc_stats_path = NULL;
+    bool jit = true;
+    GCPolicy gc_policy;
+    GCPolicyInit(&gc_policy);
+
+    // The command line goes over the environment.
+    const char* gc_settings = getenv("LOOP_GC");
+    if (gc_settings != NULL && !GCPolicyParse(&gc_policy, gc_settings))
     {
-        fprintf(stderr, "error: wrong arguments count\n");
-        fprintf(stderr, "usage: loopvm <path>\n");
         return Error_WrongArgumentsCount;
     }
 
-    const char* path = argv[1];
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--no-jit") == 0)
+        {
+            jit = false;
+            continue;
+        }
+
+        if (strncmp(argv[i], "--gc=", 5) == 0)
+        {
+            if (!GCPolicyParse(&gc_policy, argv[i] + 5))
+            {
+                return Error_WrongArgumentsCount;
+            }
+            continue;
+        }
+
+        if (ParseOutputOption(argv[i], "--profile-opcodes", &profile_opcodes, &opcode_profile_path) ||
+            ParseOutputOption(argv[i], "--profile-samples", &profile_samples, &samples_path) ||
+            ParseOutputOption(argv[i], "--gc-stats", &gc_stats, &gc_stats_path))
+        {
+            continue;
+        }
+
+        if (path != NULL)
+        {
+            path = NULL;
+            break;
+        }
+
+        path = argv[i];
+    }
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "error: wrong arguments count\n");
+        fprintf(stderr, "usage: loopvm [--profile-opcodes[=<report path>]] [--profile-samples[=<output path>]] [--gc-stats[=<output path>]] [--gc=<setting>=<value>,...] [--no-jit] <path>\n");
+        return Error_WrongArgumentsCount;
+    }
 
     VirtualMachine vm;
     {
@@ -27,16 +172,73 @@ int main(int argc, const char* argv[])
         }
     }
 
+    vm.jit = jit;
+
+    MemoryManagerSetPolicy(&vm.memory_manager, &gc_policy);
+
+    OpcodeProfile* opcode_profile = NULL;
+    if (profile_opcodes)
+    {
+        opcode_profile = malloc(sizeof(OpcodeProfile));
+        if (opcode_profile == NULL)
+        {
+            VirtualMachineDeinit(&vm);
+            return Error_OutOfMemory;
+        }
+
+        OpcodeProfileInit(opcode_profile);
+        vm.opcode_profile = opcode_profile;
+    }
+
+    Sampler sampler;
+    if (profile_samples)
+    {
+        Error err = SamplerStart(&sampler, &vm);
+        if (err != Error_None)
+        {
+            VirtualMachineDeinit(&vm);
+            free(opcode_profile);
+            return err;
+        }
+
+        vm.sampler = &sampler;
+    }
+
     ObjectModule* module = NULL;
     Error err = VirtualMachineLoadModule(&vm, vm.common.empty_string, ObjectStringFromLiteral(&vm, path), &module);
     if (err != Error_None)
     {
+        if (vm.sampler != NULL)
+        {
+            SamplerFree(&sampler);
+        }
         VirtualMachineDeinit(&vm);
+        free(opcode_profile);
         return err;
     }
 
     Error error = VirtualMachineRunScript(&vm, module->script);
 
+    // Names and lines are looked up while the functions are still alive.
+    if (vm.sampler != NULL)
+    {
+        SamplerStop(&sampler);
+        WriteSamples(&sampler, samples_path);
+        SamplerFree(&sampler);
+        vm.sampler = NULL;
+    }
+
+    if (gc_stats)
+    {
+        WriteGCStats(&vm.memory_manager, gc_stats_path);
+    }
+
+    if (opcode_profile != NULL)
+    {
+        WriteOpcodeProfile(opcode_profile, opcode_profile_path);
+        free(opcode_profile);
+    }
+
     VirtualMachineDeinit(&vm);
 
     #ifdef LOOP_DEBUG_MODE